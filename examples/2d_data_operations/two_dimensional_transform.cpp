@@ -1,5 +1,6 @@
 #include "yap/buffer_queue.h"
 #include "yap/pipeline.h"
+#include "yap/recycle.h"
 
 #include <algorithm>
 #include <bits/c++config.h>
@@ -14,6 +15,16 @@ namespace
 
 constexpr std::size_t kNDataPoints = 10'000;
 
+using int_mat_t = std::vector<std::vector<int>>;
+using float_mat_t = std::vector<std::vector<float>>;
+
+// Matrices consumed downstream are handed back to the stages producing them.
+struct Recyclers
+{
+    yap::Recycler<int_mat_t> ints{64};
+    yap::Recycler<float_mat_t> floats{64};
+};
+
 template <typename T> class random_generator
 {
     using distribution_t =
@@ -50,12 +61,14 @@ class MatGenerator
     random_generator<unsigned> _rgen;
     std::size_t _width, _height;
     std::size_t _reps = 0;
+    Recyclers _recyclers;
 
     std::vector<std::vector<int>> _lastMat;
 
   public:
-    MatGenerator(std::size_t width, std::size_t height)
-        : _rgen(0, 255, true), _width(width), _height(height)
+    MatGenerator(std::size_t width, std::size_t height, Recyclers recyclers)
+        : _rgen(0, 255, true), _width(width), _height(height),
+          _recyclers(recyclers)
     {
         _lastMat = make();
     }
@@ -70,12 +83,12 @@ class MatGenerator
         if (_reps % 5 == 0)
         {
             _lastMat = make();
-            return _lastMat;
-        }
-        else
-        {
-            return _lastMat;
         }
+
+        // Copy assignment reuses the rows of a recycled matrix.
+        auto ret = _recyclers.ints.acquire();
+        ret = _lastMat;
+        return ret;
     }
 
   private:
@@ -97,11 +110,17 @@ class MatGenerator
 
 struct MatNormalizer
 {
+    Recyclers recyclers;
+
     std::vector<std::vector<float>> operator()(
         std::vector<std::vector<int>> arg)
     {
-        std::vector<std::vector<float>> ret(
-            arg.size(), std::vector<float>(arg.front().size()));
+        auto ret = recyclers.floats.acquire();
+        ret.resize(arg.size());
+        for (auto &row : ret)
+        {
+            row.resize(arg.front().size());
+        }
 
         float sum{0};
         for (std::size_t i(0); i < arg.size(); ++i)
@@ -117,6 +136,7 @@ struct MatNormalizer
             for (float &elem : v)
                 elem /= sum;
 
+        recyclers.ints.release(std::move(arg));
         return ret;
     }
 };
@@ -146,9 +166,11 @@ struct MatModifier
 class MatCoefWriter
 {
     float &result;
+    Recyclers _recyclers;
 
   public:
-    explicit MatCoefWriter(float &out) : result(out)
+    MatCoefWriter(float &out, Recyclers recyclers)
+        : result(out), _recyclers(recyclers)
     {
     }
 
@@ -180,6 +202,7 @@ class MatCoefWriter
         }
 
         result += sum;
+        _recyclers.floats.release(std::move(arg));
     }
 };
 
@@ -188,8 +211,10 @@ class MatCoefWriter
 int main(int, char *[])
 {
     float out;
-    auto matProcessor = yap::Pipeline{} | MatGenerator(255, 255) |
-                        MatNormalizer{} | MatModifier{} | MatCoefWriter(out);
+    Recyclers recyclers;
+    auto matProcessor = yap::Pipeline{} | MatGenerator(255, 255, recyclers) |
+                        MatNormalizer{recyclers} | MatModifier{} |
+                        MatCoefWriter(out, recyclers);
     matProcessor.consume();
 
     return 0;
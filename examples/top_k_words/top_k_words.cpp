@@ -1,16 +1,12 @@
 #include "yap/pipeline.h"
+#include "yap/top_k.h"
 
-#include <algorithm>
 #include <chrono>
 #include <fstream>
 #include <iostream>
-#include <list>
-#include <memory>
 #include <sstream>
 #include <stdexcept>
 #include <string>
-#include <unordered_map>
-#include <utility>
 #include <vector>
 
 namespace
@@ -61,91 +57,6 @@ struct LineSplitter
     }
 };
 
-class FrequencyCounter
-{
-    std::unordered_map<std::string, std::size_t> _wordFreq;
-
-  public:
-    std::vector<std::pair<std::size_t, std::string>> operator()(
-        std::vector<std::string> newWords)
-    {
-        std::vector<std::pair<std::size_t, std::string>> newFreqs;
-
-        for (std::string const &word : newWords)
-        {
-            auto [it, isNew] = _wordFreq.try_emplace(word, 1);
-            if (!isNew)
-            {
-                it->second += 1;
-            }
-
-            newFreqs.emplace_back(it->second, word);
-        }
-
-        return newFreqs;
-    }
-};
-
-class KTopWords
-{
-  public:
-    using list_t = std::list<std::pair<std::size_t, std::string>>;
-
-  private:
-    list_t &_kMostFrequent;
-    std::unordered_map<std::string, list_t::iterator> _index;
-    std::size_t _k;
-
-  public:
-    explicit KTopWords(std::size_t K, list_t &list)
-        : _kMostFrequent(list), _k(K)
-    {
-        if (0 == _k)
-        {
-            throw std::logic_error("What do you mean top 0?");
-        }
-    }
-
-    void operator()(std::vector<std::pair<std::size_t, std::string>> newFreqs)
-    {
-        for (auto &[freq, word] : newFreqs)
-        {
-            if (_kMostFrequent.empty() || _kMostFrequent.back().first < freq)
-            {
-                auto it = _index.find(word);
-                if (it != _index.end())
-                {
-                    auto listIt = it->second;
-
-                    // Place word where its new frequency would mandate.
-                    _kMostFrequent.splice(
-                        std::lower_bound(
-                            _kMostFrequent.begin(), _kMostFrequent.end(),
-                            std::make_pair(freq, word), std::greater<>{}),
-                        _kMostFrequent, listIt);
-
-                    listIt->first = freq; // Update the frequency value.
-                }
-                else
-                {
-                    auto newItemIt = _kMostFrequent.insert(
-                        std::lower_bound(
-                            _kMostFrequent.begin(), _kMostFrequent.end(),
-                            std::make_pair(freq, word), std::greater<>{}),
-                        std::make_pair(freq, word));
-                    _index.emplace(word, newItemIt);
-
-                    if (_kMostFrequent.size() > _k)
-                    {
-                        _index.erase(_kMostFrequent.back().second);
-                        _kMostFrequent.pop_back();
-                    }
-                }
-            }
-        }
-    }
-};
-
 } // namespace
 
 int main(int argc, char *argv[])
@@ -164,10 +75,10 @@ int main(int argc, char *argv[])
 
     std::cout << "Counting top " << k << " words of " << argv[1] << std::endl;
 
-    KTopWords::list_t list;
+    yap::TopK<std::string> topWords(k);
 
     auto pl = yap::Pipeline{} | FileReader(argv[1]) | LineSplitter{} |
-              FrequencyCounter{} | KTopWords(k, list);
+              topWords;
 
     auto start = std::chrono::steady_clock::now();
     pl.consume();
@@ -178,7 +89,7 @@ int main(int argc, char *argv[])
         << std::chrono::duration_cast<std::chrono::milliseconds>(dur).count()
         << " ms\n\n";
 
-    for (auto [freq, word] : list)
+    for (auto const &[word, freq] : topWords.get())
     {
         std::cout << freq << " : \"" << word << "\"\n";
     }
@@ -0,0 +1,177 @@
+// © 2022 Nikolaos Athanasiou, github.com/picanumber
+#pragma once
+
+#include "runtime_utilities.h"
+#include "stage_context.h"
+#include "tokens.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <memory_resource>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace yap
+{
+
+/**
+ * @brief Size of the arena of a stage, and how often it is reset.
+ */
+struct ArenaOptions
+{
+    std::size_t bytes = 64 * 1024; // Initial buffer, grows on demand.
+    std::size_t resetEvery = 1;    // Items processed between resets.
+};
+
+namespace detail
+{
+
+/**
+ * @brief Monotonic arena for the transient allocations of a stage operation.
+ * Allocating bumps a pointer and deallocating does nothing, until the arena
+ * is reset and its initial buffer is reused from the start. Memory requested
+ * beyond the initial buffer comes from the default resource and is returned
+ * to it on reset.
+ */
+class ItemArena
+{
+    std::vector<std::byte> _buffer;
+    std::pmr::monotonic_buffer_resource _resource;
+    std::size_t _resetEvery;
+    std::size_t _items{0};
+
+  public:
+    explicit ItemArena(ArenaOptions const &options)
+        : _buffer(std::max<std::size_t>(1, options.bytes)),
+          _resource(_buffer.data(), _buffer.size()),
+          _resetEvery(std::max<std::size_t>(1, options.resetEvery))
+    {
+    }
+
+    ItemArena(ItemArena const &) = delete;
+    ItemArena &operator=(ItemArena const &) = delete;
+
+    std::pmr::memory_resource *resource() noexcept
+    {
+        return &_resource;
+    }
+
+    // An item was processed. Resets the arena every so many items.
+    void itemDone()
+    {
+        if (++_items >= _resetEvery)
+        {
+            _items = 0;
+            _resource.release();
+        }
+    }
+};
+
+template <class F>
+concept arena_op = requires { typename std::remove_cvref_t<F>::arena_tag; };
+
+// Keeps the Stateless marker of a wrapped operation visible.
+template <class F> struct ArenaTags
+{
+};
+
+template <stateless_op F> struct ArenaTags<F>
+{
+    using stateless_tag = void;
+};
+
+} // namespace detail
+
+/**
+ * @brief Runs an operation with an arena for its transient allocations, which
+ * the operation gets from StageContext::arena(). The stage resets the arena
+ * after every item, or every resetEvery items, so temporary strings and
+ * vectors cost a pointer bump instead of a trip to malloc:
+ *
+ *     auto split = [](std::string line, yap::StageContext &ctx) {
+ *         std::pmr::vector<std::pmr::string> words(ctx.arena());
+ *         // ...
+ *         return countOf(words);
+ *     };
+ *     auto pl = yap::Pipeline{} | read | yap::ArenaBacked(split) | sink;
+ *
+ * Outputs must not hold arena memory, since it is reused for later items. A
+ * Stateless operation keeps its marker when wrapped, and each token worker
+ * that runs it gets an arena of its own.
+ *
+ * @tparam F Type of the wrapped operation.
+ */
+template <class F> class ArenaBacked : public detail::ArenaTags<F>
+{
+    F _op;
+    ArenaOptions _options;
+
+  public:
+    using emitting_tag = void;
+    using arena_tag = void;
+
+    template <class... Args> using output_t = op_result_t<F, Args...>;
+
+    explicit ArenaBacked(F op, ArenaOptions options = {})
+        : _op(std::move(op)), _options(options)
+    {
+    }
+
+    ArenaOptions const &arena() const noexcept
+    {
+        return _options;
+    }
+
+    template <class E, class... Args>
+    void feed(StageContext &ctx, E &&emit, Args &&...args)
+    {
+        detail::apply_op(_op, ctx, emit, std::forward<Args>(args)...);
+    }
+
+    void on_start()
+        requires detail::start_hook<F>
+    {
+        _op.on_start();
+    }
+
+    void on_stop()
+        requires detail::stop_hook<F>
+    {
+        _op.on_stop();
+    }
+
+    void on_barrier()
+        requires detail::barrier_hook<F>
+    {
+        _op.on_barrier();
+    }
+};
+
+template <class F> ArenaBacked(F) -> ArenaBacked<F>;
+template <class F> ArenaBacked(F, ArenaOptions) -> ArenaBacked<F>;
+
+namespace detail
+{
+
+// Options of the arena of a stage constructed with the given operation.
+template <class F> std::optional<ArenaOptions> arenaOf(F const &op)
+{
+    if constexpr (arena_op<F>)
+    {
+        return op.arena();
+    }
+    else if constexpr (wrapping_op<F>)
+    {
+        return arenaOf(op.wrapped());
+    }
+    else
+    {
+        return std::nullopt;
+    }
+}
+
+} // namespace detail
+
+} // namespace yap
@@ -0,0 +1,230 @@
+// © 2022 Nikolaos Athanasiou, github.com/picanumber
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace yap
+{
+
+/**
+ * @brief Selects the self tuning mode of a pipeline: stages are profiled while
+ * data flows and adjacent stages are fused whenever handing items over between
+ * them costs a large fraction of their work. Fused stages are split again
+ * once this no longer holds.
+ */
+struct AutoFuse
+{
+    // Items produced by the generator between decisions. The first window is
+    // the warm-up, after which decisions are revised every window.
+    std::size_t window = 1024;
+
+    // Fuse two stages when the handoff cost is at least this fraction of the
+    // service time of the stages. Fused stages are split when it falls below
+    // half of it.
+    double threshold = 0.5;
+
+    // Receives a description of every decision.
+    std::function<void(std::string const &)> log = [](std::string const &m) {
+        std::clog << "yap: " << m << '\n';
+    };
+};
+
+namespace detail
+{
+
+using profile_clock = std::chrono::steady_clock;
+
+inline std::uint64_t elapsedNs(profile_clock::time_point since)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               profile_clock::now() - since)
+        .count();
+}
+
+/**
+ * @brief Time a stage spends in each part of its cycle. Items handed over
+ * inline are processed by the producing thread, so the time spent in such a
+ * push is the work of the consumer and not link overhead.
+ */
+struct StageProfile
+{
+    std::atomic<std::uint64_t> items{0}, busyNs{0};
+    std::atomic<std::uint64_t> pushes{0}, pushNs{0}, inlineNs{0};
+    std::atomic<std::uint64_t> pops{0}, popNs{0};
+};
+
+/**
+ * @brief Decides which links of a pipeline hand items over inline, from the
+ * profiles of its stages.
+ */
+class FusionController
+{
+    // Per item estimates of a stage, kept across windows where the stage
+    // had no data or a link was not measured because it was fused.
+    struct Estimate
+    {
+        double service{0}, push{0}, pop{0};
+        std::uint64_t items{0}, busy{0}, pushes{0}, push_ns{0}, inline_ns{0},
+            pops{0}, pop_ns{0};
+    };
+
+    AutoFuse _config;
+    std::unique_ptr<StageProfile[]> _profiles;
+    std::vector<Estimate> _estimates;
+    std::vector<std::function<void(bool)>> _links;
+    std::vector<bool> _fused;
+    std::atomic<std::uint64_t> _ticks{0};
+    std::mutex _mtx;
+
+  public:
+    explicit FusionController(AutoFuse config) : _config(std::move(config))
+    {
+        _config.window = std::max<std::size_t>(1, _config.window);
+    }
+
+    bool bound() const noexcept
+    {
+        return nullptr != _profiles;
+    }
+
+    // Attach to the stages of a pipeline. links[i] toggles inline handoff
+    // between stage i and stage i + 1.
+    void bind(std::size_t nStages, std::vector<std::function<void(bool)>> links)
+    {
+        _profiles = std::make_unique<StageProfile[]>(nStages);
+        _estimates.resize(nStages);
+        _links = std::move(links);
+        _fused.assign(_links.size(), false);
+    }
+
+    StageProfile *profile(std::size_t stage) noexcept
+    {
+        return &_profiles[stage];
+    }
+
+    // Called by the generator for every item produced.
+    void tick()
+    {
+        if (0 == ++_ticks % _config.window)
+        {
+            std::lock_guard lk(_mtx);
+            evaluate();
+        }
+    }
+
+  private:
+    void evaluate()
+    {
+        for (std::size_t i(0); i < _estimates.size(); ++i)
+        {
+            update(_estimates[i], _profiles[i]);
+        }
+
+        // The slowest stage bounds the throughput. Fusing is only allowed
+        // while the fused group is not slower than that.
+        double bottleneck = 0;
+        for (auto const &e : _estimates)
+        {
+            bottleneck = std::max(bottleneck, e.pop + e.service + e.push);
+        }
+
+        double groupIn = _estimates[0].pop;
+        double groupService = _estimates[0].service;
+        for (std::size_t i(0); i < _links.size(); ++i)
+        {
+            auto const &up = _estimates[i];
+            auto const &down = _estimates[i + 1];
+
+            double handoff = up.push + down.pop;
+            double work = up.service + down.service;
+            double ratio = work > 0 ? handoff / work : 0;
+            double groupCycle =
+                groupIn + groupService + down.service + down.push;
+
+            bool fuse = ratio >= (_fused[i] ? _config.threshold / 2
+                                            : _config.threshold) &&
+                        groupCycle <= bottleneck;
+
+            if (fuse)
+            {
+                groupService += down.service;
+            }
+            else
+            {
+                groupIn = down.pop;
+                groupService = down.service;
+            }
+
+            if (fuse != _fused[i])
+            {
+                _fused[i] = fuse;
+                _links[i](fuse);
+                report(i, fuse, handoff, up.service, down.service);
+            }
+        }
+    }
+
+    static void update(Estimate &e, StageProfile const &p)
+    {
+        auto items = p.items.load(), busy = p.busyNs.load();
+        auto pushes = p.pushes.load(), pushNs = p.pushNs.load();
+        auto inlineNs = p.inlineNs.load();
+        auto pops = p.pops.load(), popNs = p.popNs.load();
+
+        if (items > e.items)
+        {
+            double work = static_cast<double>(busy - e.busy) -
+                          static_cast<double>(pushNs - e.push_ns) -
+                          static_cast<double>(inlineNs - e.inline_ns);
+            e.service = std::max(0.0, work) / (items - e.items);
+        }
+        if (pushes > e.pushes)
+        {
+            e.push = static_cast<double>(pushNs - e.push_ns) /
+                     (pushes - e.pushes);
+        }
+        if (pops > e.pops)
+        {
+            e.pop = static_cast<double>(popNs - e.pop_ns) / (pops - e.pops);
+        }
+
+        e.items = items;
+        e.busy = busy;
+        e.pushes = pushes;
+        e.push_ns = pushNs;
+        e.inline_ns = inlineNs;
+        e.pops = pops;
+        e.pop_ns = popNs;
+    }
+
+    void report(std::size_t link, bool fused, double handoff, double upService,
+                double downService) const
+    {
+        if (!_config.log)
+        {
+            return;
+        }
+
+        std::ostringstream msg;
+        msg << (fused ? "fusing" : "splitting") << " stages " << link
+            << " and " << link + 1 << ": handoff " << handoff
+            << "ns per item, service " << upService << "ns and "
+            << downService << "ns per item";
+        _config.log(msg.str());
+    }
+};
+
+} // namespace detail
+
+} // namespace yap
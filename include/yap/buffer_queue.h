@@ -2,10 +2,14 @@
 #pragma once
 
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <cstddef>
 #include <deque>
 #include <mutex>
+#include <optional>
 #include <stdexcept>
+#include <stop_token>
 
 namespace yap
 {
@@ -32,14 +36,46 @@ struct ClosedError : std::logic_error
     }
 };
 
+/**
+ * @brief Notified after every push to a buffer it listens to.
+ */
+struct PushListener
+{
+    virtual ~PushListener() = default;
+    virtual void onPush() = 0;
+};
+
+/**
+ * @brief Processes items on the thread that pushes them, when the buffer
+ * hands items over inline.
+ *
+ * @return Whether the consumer keeps processing, i.e. false at the end of the
+ * stream.
+ */
+template <class T> struct InlineConsumer
+{
+    virtual ~InlineConsumer() = default;
+    virtual bool consumeInline(T item) = 0;
+};
+
 } // namespace detail
 
 template <class T> class BufferQueue final
 {
     std::deque<T> _contents;
     mutable std::mutex _mtx;
-    mutable std::condition_variable _bell;
+    mutable std::condition_variable_any _bell;
     BufferBehavior _popCondition{BufferBehavior::WaitOnEmpty};
+    std::atomic<detail::PushListener *> _listener{nullptr};
+    std::size_t _capacity{0}; // Items held before pushing blocks, 0 if any.
+
+    // Inline handoff: while enabled, an item pushed to an empty buffer whose
+    // consumer is parked in pop is processed by the pushing thread instead.
+    std::atomic_bool _handoff{false};
+    detail::InlineConsumer<T> *_consumer{nullptr};
+    std::size_t _waiters{0}; // Consumers blocked in pop.
+    bool _handing{false};    // An item is being processed inline.
+    bool _released{false};   // The consumer met the end of the stream inline.
 
   public:
     void clear()
@@ -51,27 +87,73 @@ template <class T> class BufferQueue final
         _bell.notify_all();
     }
 
-    template <class... Args> void push(Args &&...args)
+    // Returns whether the item was processed inline by the consumer. Pushing
+    // this way ignores the bound of the buffer, if any.
+    template <class... Args> bool push(Args &&...args)
     {
-        {
-            std::unique_lock lk(_mtx);
-            _bell.wait(
-                lk, [this] { return _popCondition != BufferBehavior::Frozen; });
+        std::unique_lock lk(_mtx);
+        _bell.wait(
+            lk, [this] { return _popCondition != BufferBehavior::Frozen; });
+        return store(lk, [&args...] { return T(std::forward<Args>(args)...); });
+    }
 
-            if (BufferBehavior::Closed == _popCondition)
-            {
-                throw detail::ClosedError(false);
-            }
+    /**
+     * @brief Push the item returned by make, once the buffer has room. Only
+     * bounded buffers run out of room. Throws ClosedError, without invoking
+     * make, if the buffer is closed.
+     *
+     * @return Whether the item was processed inline by the consumer.
+     */
+    template <class M> bool pushMade(M &&make)
+    {
+        std::unique_lock lk(_mtx);
+        _bell.wait(lk, [this] { return hasRoom(); });
+        return store(lk, std::forward<M>(make));
+    }
+
+    /**
+     * @brief Like pushMade, waiting at most timeout for room.
+     *
+     * @return False, without invoking make, if the buffer stayed full.
+     */
+    template <class M, class Rep, class Period>
+    bool pushMadeFor(M &&make, std::chrono::duration<Rep, Period> timeout)
+    {
+        std::unique_lock lk(_mtx);
+        if (!_bell.wait_for(lk, timeout, [this] { return hasRoom(); }))
+        {
+            return false;
+        }
+        store(lk, std::forward<M>(make));
+        return true;
+    }
 
-            _contents.emplace_back(std::forward<Args>(args)...);
+    // Bound the number of items held, 0 for no bound. Pushing a made item to
+    // a full buffer waits until the consumer pops.
+    void limit(std::size_t capacity)
+    {
+        {
+            std::lock_guard lk(_mtx);
+            _capacity = capacity;
         }
         _bell.notify_all();
     }
 
-    auto pop()
+    // Blocks until an item is available. Throws ClosedError when the buffer
+    // is closed, or stop is requested while waiting.
+    auto pop(std::stop_token stop = {})
     {
         std::unique_lock lk(_mtx);
-        _bell.wait(lk, [this] {
+        ++_waiters;
+        bool ready = _bell.wait(lk, stop, [this] {
+            if (_handing)
+            {
+                return false; // The consumer is busy on the pushing thread.
+            }
+            if (_released)
+            {
+                return true;
+            }
             switch (_popCondition)
             {
             case BufferBehavior::Closed:
@@ -83,7 +165,19 @@ template <class T> class BufferQueue final
                 return false;
             }
         });
+        --_waiters;
 
+        if (!ready)
+        {
+            // Stopped. Let an item processed inline finish first.
+            _bell.wait(lk, [this] { return !_handing; });
+            throw detail::ClosedError(true);
+        }
+        if (_released)
+        {
+            _released = false;
+            throw detail::ClosedError(true);
+        }
         if (BufferBehavior::Closed == _popCondition)
         {
             throw detail::ClosedError(true);
@@ -91,9 +185,80 @@ template <class T> class BufferQueue final
 
         auto ret{std::move(_contents.at(0))};
         _contents.pop_front();
+        if (_capacity)
+        {
+            _bell.notify_all(); // Producers may wait for room.
+        }
+        return ret;
+    }
+
+    // Non blocking pop. Returns nothing if the buffer is empty or frozen.
+    std::optional<T> tryPop()
+    {
+        std::lock_guard lk(_mtx);
+        if (BufferBehavior::Closed == _popCondition)
+        {
+            throw detail::ClosedError(true);
+        }
+        if (BufferBehavior::Frozen == _popCondition || _contents.empty())
+        {
+            return std::nullopt;
+        }
+
+        std::optional<T> ret{std::move(_contents.front())};
+        _contents.pop_front();
+        if (_capacity)
+        {
+            _bell.notify_all();
+        }
         return ret;
     }
 
+    // Register the entity to notify after every push. Null to unregister.
+    void listen(detail::PushListener *listener)
+    {
+        _listener.store(listener);
+    }
+
+    /**
+     * @brief Hand an item over to the consumer, if it is parked waiting for
+     * input, and process it on the calling thread.
+     *
+     * @return False, leaving the item untouched, if the consumer is busy or
+     * input is queued.
+     */
+    bool offer(T &item)
+    {
+        detail::InlineConsumer<T> *consumer = nullptr;
+        {
+            std::lock_guard lk(_mtx);
+            if (BufferBehavior::WaitOnEmpty != _popCondition || !consumerIdle())
+            {
+                return false;
+            }
+
+            _handing = true;
+            consumer = _consumer;
+        }
+
+        handOver(consumer, std::move(item));
+        return true;
+    }
+
+    // Register the consumer processing items handed over inline. Null to
+    // unregister.
+    void attach(detail::InlineConsumer<T> *consumer)
+    {
+        std::lock_guard lk(_mtx);
+        _consumer = consumer;
+    }
+
+    // Enable or disable inline handoff.
+    void handoff(bool enable)
+    {
+        _handoff.store(enable);
+    }
+
     void set(BufferBehavior val)
     {
         {
@@ -102,6 +267,75 @@ template <class T> class BufferQueue final
         }
         _bell.notify_all();
     }
+
+  private:
+    // Expects the mutex to be held. A closed buffer has room, so that pushing
+    // to it fails instead of waiting.
+    bool hasRoom() const
+    {
+        if (BufferBehavior::Frozen == _popCondition)
+        {
+            return false;
+        }
+        return BufferBehavior::Closed == _popCondition || !_capacity ||
+               _contents.size() < _capacity;
+    }
+
+    // Store the item returned by make, or process it inline. Expects the
+    // buffer to have room, with the mutex held by lk.
+    template <class M> bool store(std::unique_lock<std::mutex> &lk, M &&make)
+    {
+        if (BufferBehavior::Closed == _popCondition)
+        {
+            throw detail::ClosedError(false);
+        }
+
+        if (_handoff.load(std::memory_order_relaxed) && consumerIdle())
+        {
+            _handing = true;
+            auto *consumer = _consumer;
+            lk.unlock();
+
+            handOver(consumer, std::forward<M>(make)());
+            return true;
+        }
+
+        _contents.push_back(std::forward<M>(make)());
+        lk.unlock();
+        _bell.notify_all();
+
+        if (auto *listener = _listener.load())
+        {
+            listener->onPush();
+        }
+        return false;
+    }
+
+    // Expects the mutex to be held.
+    bool consumerIdle() const
+    {
+        return _consumer && _waiters && _contents.empty() && !_handing;
+    }
+
+    void handOver(detail::InlineConsumer<T> *consumer, T item)
+    {
+        bool keepProcessing = true;
+        try
+        {
+            keepProcessing = consumer->consumeInline(std::move(item));
+        }
+        catch (...)
+        {
+            keepProcessing = true;
+        }
+
+        {
+            std::lock_guard lk(_mtx);
+            _handing = false;
+            _released = !keepProcessing;
+        }
+        _bell.notify_all();
+    }
 };
 
 // A void queue, is an empty but valid class.
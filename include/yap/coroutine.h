@@ -0,0 +1,477 @@
+// © 2022 Nikolaos Athanasiou, github.com/picanumber
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+namespace yap
+{
+
+namespace detail
+{
+
+/**
+ * @brief Runs the coroutine of a stage: resumes it whenever an awaited
+ * operation completes, and learns when it finishes.
+ */
+struct CoDriver
+{
+    virtual ~CoDriver() = default;
+
+    // An awaited operation completed, so the coroutine can continue.
+    virtual void schedule(std::coroutine_handle<> h) = 0;
+
+    // The coroutine finished. Called once, possibly before start returns.
+    virtual void complete() = 0;
+};
+
+// Continues the awaiting coroutine, if any, when a coroutine finishes.
+struct FinalAwaiter
+{
+    bool await_ready() noexcept
+    {
+        return false;
+    }
+
+    template <class P>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept
+    {
+        auto &promise = h.promise();
+        if (promise.continuation)
+        {
+            return promise.continuation;
+        }
+
+        // The frame may be destroyed as soon as the driver learns about the
+        // completion, so it's not touched afterwards.
+        promise.driver->complete();
+        return std::noop_coroutine();
+    }
+
+    void await_resume() noexcept
+    {
+    }
+};
+
+struct PromiseBase
+{
+    CoDriver *driver{nullptr};
+    std::coroutine_handle<> continuation;
+    std::exception_ptr error;
+
+    std::suspend_always initial_suspend() noexcept
+    {
+        return {};
+    }
+
+    FinalAwaiter final_suspend() noexcept
+    {
+        return {};
+    }
+
+    void unhandled_exception() noexcept
+    {
+        error = std::current_exception();
+    }
+};
+
+template <class T> struct TaskValue : PromiseBase
+{
+    std::optional<T> value;
+
+    void return_value(T val)
+    {
+        value.emplace(std::move(val));
+    }
+
+    T get()
+    {
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+        return std::move(*value);
+    }
+};
+
+template <> struct TaskValue<void> : PromiseBase
+{
+    void return_void() noexcept
+    {
+    }
+
+    void get()
+    {
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+};
+
+// Runs an awaited task on the driver of the awaiting coroutine.
+template <class P> struct TaskAwaiter
+{
+    std::coroutine_handle<P> callee;
+
+    bool await_ready() noexcept
+    {
+        return false;
+    }
+
+    template <class Q>
+    std::coroutine_handle<> await_suspend(
+        std::coroutine_handle<Q> caller) noexcept
+    {
+        callee.promise().driver = caller.promise().driver;
+        callee.promise().continuation = caller;
+        return callee;
+    }
+
+    decltype(auto) await_resume()
+    {
+        return callee.promise().get();
+    }
+};
+
+template <class T> struct async_done
+{
+    using type = std::function<void(T)>;
+};
+
+template <> struct async_done<void>
+{
+    using type = std::function<void()>;
+};
+
+} // namespace detail
+
+/**
+ * @brief Result of a coroutine stage operation, or of a coroutine awaited by
+ * one. A stage operation returning Task<T> behaves as one returning T, except
+ * that it can co_await timers, asynchronous operations and other tasks:
+ *
+ *     auto fetch = [](Request r) -> yap::Task<Response> {
+ *         co_await yap::sleep_for(5ms);
+ *         co_return co_await lookup(r);
+ *     };
+ *
+ * In executor mode a suspended stage yields its thread to other stages until
+ * the awaited operation completes. Otherwise the thread of the stage waits
+ * and resumes the coroutine itself.
+ *
+ * @tparam T Type of the value returned with co_return.
+ */
+template <class T = void> class [[nodiscard]] Task
+{
+  public:
+    struct promise_type : detail::TaskValue<T>
+    {
+        Task get_return_object()
+        {
+            return Task(
+                std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+    };
+
+  private:
+    std::coroutine_handle<promise_type> _handle;
+
+    explicit Task(std::coroutine_handle<promise_type> h) : _handle(h)
+    {
+    }
+
+  public:
+    Task(Task &&other) noexcept : _handle(std::exchange(other._handle, {}))
+    {
+    }
+
+    Task &operator=(Task &&other) noexcept
+    {
+        if (this != &other)
+        {
+            if (_handle)
+            {
+                _handle.destroy();
+            }
+            _handle = std::exchange(other._handle, {});
+        }
+        return *this;
+    }
+
+    ~Task()
+    {
+        if (_handle)
+        {
+            _handle.destroy();
+        }
+    }
+
+    /**
+     * @brief Run the coroutine until it first suspends. The driver resumes it
+     * afterwards, and is notified when it finishes.
+     */
+    void start(detail::CoDriver &driver)
+    {
+        _handle.promise().driver = &driver;
+        _handle.resume();
+    }
+
+    // The value of a finished coroutine. Rethrows what escaped its body.
+    T get()
+    {
+        return _handle.promise().get();
+    }
+
+    // Await a task from another coroutine, on the driver of the awaiting one.
+    detail::TaskAwaiter<promise_type> operator co_await() && noexcept
+    {
+        return {_handle};
+    }
+};
+
+namespace detail
+{
+
+/**
+ * @brief Thread that fires timers in deadline order. Started on first use.
+ */
+class TimerQueue
+{
+    using clock = std::chrono::steady_clock;
+
+    std::multimap<clock::time_point, std::function<void()>> _timers;
+    std::mutex _mtx;
+    std::condition_variable _bell;
+    bool _closing{false};
+    std::thread _thread;
+
+    TimerQueue() : _thread(&TimerQueue::run, this)
+    {
+    }
+
+  public:
+    TimerQueue(TimerQueue const &) = delete;
+    TimerQueue &operator=(TimerQueue const &) = delete;
+
+    ~TimerQueue()
+    {
+        {
+            std::lock_guard lk(_mtx);
+            _closing = true;
+        }
+        _bell.notify_one();
+        _thread.join();
+    }
+
+    static TimerQueue &instance()
+    {
+        static TimerQueue queue;
+        return queue;
+    }
+
+    void add(clock::time_point deadline, std::function<void()> fire)
+    {
+        {
+            std::lock_guard lk(_mtx);
+            _timers.emplace(deadline, std::move(fire));
+        }
+        _bell.notify_one();
+    }
+
+  private:
+    void run()
+    {
+        std::unique_lock lk(_mtx);
+        while (!_closing)
+        {
+            if (_timers.empty())
+            {
+                _bell.wait(lk);
+                continue;
+            }
+
+            auto next = _timers.begin();
+            if (clock::now() < next->first)
+            {
+                _bell.wait_until(lk, next->first);
+                continue;
+            }
+
+            auto fire = std::move(next->second);
+            _timers.erase(next);
+            lk.unlock();
+            fire();
+            lk.lock();
+        }
+    }
+};
+
+struct Sleep
+{
+    std::chrono::steady_clock::time_point deadline;
+
+    bool await_ready() const noexcept
+    {
+        return std::chrono::steady_clock::now() >= deadline;
+    }
+
+    template <class P> void await_suspend(std::coroutine_handle<P> h)
+    {
+        TimerQueue::instance().add(deadline, [driver = h.promise().driver, h] {
+            driver->schedule(h);
+        });
+    }
+
+    void await_resume() const noexcept
+    {
+    }
+};
+
+/**
+ * @brief Drives a coroutine on the calling thread, which waits until the
+ * coroutine can continue or has finished.
+ */
+class BlockingDriver final : public CoDriver
+{
+    std::mutex _mtx;
+    std::condition_variable _bell;
+    std::deque<std::coroutine_handle<>> _ready;
+    bool _done{false};
+
+  public:
+    void schedule(std::coroutine_handle<> h) override
+    {
+        std::lock_guard lk(_mtx);
+        _ready.push_back(h);
+        _bell.notify_one();
+    }
+
+    void complete() override
+    {
+        // Notify under the lock, since the waiter destroys the driver.
+        std::lock_guard lk(_mtx);
+        _done = true;
+        _bell.notify_one();
+    }
+
+    void run()
+    {
+        std::unique_lock lk(_mtx);
+        while (true)
+        {
+            _bell.wait(lk, [this] { return _done || !_ready.empty(); });
+            if (_done)
+            {
+                return;
+            }
+
+            auto h = _ready.front();
+            _ready.pop_front();
+            lk.unlock();
+            h.resume();
+            lk.lock();
+        }
+    }
+};
+
+/**
+ * @brief Run a task to completion on the calling thread.
+ */
+template <class T> T wait(Task<T> &task)
+{
+    BlockingDriver driver;
+    task.start(driver);
+    driver.run();
+    return task.get();
+}
+
+} // namespace detail
+
+/**
+ * @brief Suspend a coroutine stage for the given time.
+ */
+template <class Rep, class Period>
+detail::Sleep sleep_for(std::chrono::duration<Rep, Period> duration)
+{
+    return {std::chrono::steady_clock::now() +
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                duration)};
+}
+
+/**
+ * @brief Suspend a coroutine stage until the given time point.
+ */
+inline detail::Sleep sleep_until(std::chrono::steady_clock::time_point when)
+{
+    return {when};
+}
+
+/**
+ * @brief Adapts a callback based asynchronous operation to co_await. The
+ * operation is started with a completion callback, which is invoked with the
+ * result, from any thread, once the operation is done:
+ *
+ *     auto bytes = co_await yap::Async<std::size_t>([&](auto done) {
+ *         socket.async_read(buffer, [done](std::size_t n) { done(n); });
+ *     });
+ *
+ * @tparam T Type of the result, void for operations without one.
+ */
+template <class T = void> class Async
+{
+    using done_t = typename detail::async_done<T>::type;
+    using value_t = std::conditional_t<std::is_void_v<T>, bool, T>;
+
+    std::function<void(done_t)> _start;
+    std::optional<value_t> _value;
+
+  public:
+    explicit Async(std::function<void(done_t)> start) : _start(std::move(start))
+    {
+    }
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    template <class P> void await_suspend(std::coroutine_handle<P> h)
+    {
+        auto *driver = h.promise().driver;
+        if constexpr (std::is_void_v<T>)
+        {
+            _start([this, driver, h] {
+                _value.emplace(true);
+                driver->schedule(h);
+            });
+        }
+        else
+        {
+            _start([this, driver, h](T value) {
+                _value.emplace(std::move(value));
+                driver->schedule(h);
+            });
+        }
+    }
+
+    T await_resume()
+    {
+        if constexpr (!std::is_void_v<T>)
+        {
+            return std::move(*_value);
+        }
+    }
+};
+
+} // namespace yap
@@ -0,0 +1,462 @@
+// © 2022 Nikolaos Athanasiou, github.com/picanumber
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <time.h>
+#endif
+
+namespace yap
+{
+
+/**
+ * @brief Selects the executor mode of a pipeline: instead of a dedicated thread
+ * per stage, stages become tasks on a fixed pool of work-stealing threads.
+ */
+struct WorkStealing
+{
+    std::size_t threads = std::thread::hardware_concurrency();
+};
+
+namespace detail
+{
+
+// CPU time consumed by the calling thread, or elapsed time where the platform
+// has no per thread clock.
+inline std::uint64_t threadCpuNs()
+{
+#if defined(CLOCK_THREAD_CPUTIME_ID)
+    timespec ts;
+    if (0 == clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts))
+    {
+        return static_cast<std::uint64_t>(ts.tv_sec) * 1'000'000'000 +
+               static_cast<std::uint64_t>(ts.tv_nsec);
+    }
+#endif
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+/**
+ * @brief The share of a pool that belongs to one pipeline. Tenants with
+ * pending tasks are served by deficit round-robin: every round credits a
+ * tenant with a quantum of time proportional to its weight, and the CPU time
+ * of each task it runs is charged against that credit.
+ */
+struct Tenant
+{
+    explicit Tenant(std::size_t w) : weight(std::max<std::size_t>(1, w))
+    {
+    }
+
+    std::size_t const weight;
+    std::atomic<std::uint64_t> cpuNs{0};
+
+    // Guarded by the pool.
+    std::deque<std::function<void()>> tasks;
+    std::int64_t deficit{0};
+    bool active{false};
+};
+
+/**
+ * @brief Fixed pool of threads, each one with its own task deque. Tasks posted
+ * from a worker go to its own deque and are processed LIFO, so a task
+ * scheduled by the task that just ran finds its data in cache. Idle workers
+ * steal from the other end of their peers' deques. Tasks posted from outside
+ * the pool go to a shared injection queue. Tasks of a tenant go to its own
+ * queue, so that pipelines sharing the pool get a fair share of it.
+ *
+ * A pool can also run on threads it doesn't own: every posted task is then
+ * matched by a call to a foreign scheduler, which runs the next due task.
+ */
+class WorkStealingPool : public std::enable_shared_from_this<WorkStealingPool>
+{
+  public:
+    using task_t = std::function<void()>;
+    using scheduler_t = std::function<void(task_t)>;
+
+  private:
+
+    struct Worker
+    {
+        std::deque<task_t> tasks;
+        std::mutex mtx;
+    };
+
+    std::vector<std::unique_ptr<Worker>> _workers;
+    std::vector<std::thread> _threads;
+
+    std::deque<task_t> _injected;
+    std::mutex _injectedMtx;
+
+    // Tenants with pending tasks, in round-robin order.
+    std::deque<std::shared_ptr<Tenant>> _ring;
+    std::mutex _ringMtx;
+
+    // Time credited to a tenant of unit weight on every round.
+    static constexpr std::int64_t kQuantumNs = 50'000;
+
+    scheduler_t _foreign;
+
+    std::atomic_size_t _pending{0};
+    std::atomic_size_t _sleepers{0};
+    std::mutex _sleepMtx;
+    std::condition_variable _wake;
+    bool _closing{false};
+
+    static inline thread_local WorkStealingPool *tl_pool{nullptr};
+    static inline thread_local std::size_t tl_index{0};
+
+  public:
+    explicit WorkStealingPool(std::size_t nThreads)
+    {
+        nThreads = std::max<std::size_t>(1, nThreads);
+
+        _workers.reserve(nThreads);
+        for (std::size_t i(0); i < nThreads; ++i)
+        {
+            _workers.emplace_back(std::make_unique<Worker>());
+        }
+
+        _threads.reserve(nThreads);
+        for (std::size_t i(0); i < nThreads; ++i)
+        {
+            _threads.emplace_back(&WorkStealingPool::work, this, i);
+        }
+    }
+
+    // A pool without threads, whose tasks run on the given scheduler.
+    explicit WorkStealingPool(scheduler_t foreign)
+        : _foreign(std::move(foreign))
+    {
+    }
+
+    WorkStealingPool(WorkStealingPool const &) = delete;
+    WorkStealingPool &operator=(WorkStealingPool const &) = delete;
+
+    // Pending tasks are processed before the workers exit.
+    ~WorkStealingPool()
+    {
+        {
+            std::lock_guard lk(_sleepMtx);
+            _closing = true;
+        }
+        _wake.notify_all();
+
+        for (auto &t : _threads)
+        {
+            t.join();
+        }
+    }
+
+    std::size_t size() const noexcept
+    {
+        return _threads.size();
+    }
+
+    bool foreign() const noexcept
+    {
+        return static_cast<bool>(_foreign);
+    }
+
+    void post(task_t task, std::shared_ptr<Tenant> const &tenant = nullptr)
+    {
+        _pending.fetch_add(1);
+        if (tenant)
+        {
+            enqueue(tenant, std::move(task));
+        }
+        else if (this == tl_pool)
+        {
+            auto &worker = *_workers[tl_index];
+            std::lock_guard lk(worker.mtx);
+            worker.tasks.push_back(std::move(task));
+        }
+        else
+        {
+            std::lock_guard lk(_injectedMtx);
+            _injected.push_back(std::move(task));
+        }
+
+        dispatch();
+    }
+
+    // Post a task behind all pending work, e.g. to yield the current thread.
+    void defer(task_t task, std::shared_ptr<Tenant> const &tenant = nullptr)
+    {
+        _pending.fetch_add(1);
+        if (tenant)
+        {
+            enqueue(tenant, std::move(task));
+        }
+        else
+        {
+            std::lock_guard lk(_injectedMtx);
+            _injected.push_back(std::move(task));
+        }
+
+        dispatch();
+    }
+
+  private:
+    // Make sure a thread will pick up the task just posted.
+    void dispatch()
+    {
+        if (_foreign)
+        {
+            // The closure keeps the pool alive until it runs.
+            _foreign([self = shared_from_this()] { self->runOne(); });
+        }
+        else
+        {
+            wakeOne();
+        }
+    }
+
+    // Run the next due task on a foreign thread.
+    void runOne()
+    {
+        task_t task;
+        std::shared_ptr<Tenant> tenant;
+        if (popFair(task, tenant) || popInjected(task))
+        {
+            _pending.fetch_sub(1);
+            run(task, tenant);
+        }
+    }
+
+    void run(task_t &task, std::shared_ptr<Tenant> &tenant)
+    {
+        auto since = tenant ? threadCpuNs() : 0;
+        try
+        {
+            task();
+        }
+        catch (...)
+        {
+            // Tasks are not expected to throw.
+        }
+        task = nullptr;
+
+        if (tenant)
+        {
+            charge(*tenant, threadCpuNs() - since);
+            tenant = nullptr;
+        }
+    }
+
+    void enqueue(std::shared_ptr<Tenant> const &tenant, task_t task)
+    {
+        std::lock_guard lk(_ringMtx);
+        tenant->tasks.push_back(std::move(task));
+        if (!tenant->active)
+        {
+            tenant->active = true;
+            _ring.push_back(tenant);
+        }
+    }
+
+    void wakeOne()
+    {
+        if (_sleepers.load())
+        {
+            {
+                std::lock_guard lk(_sleepMtx);
+            }
+            _wake.notify_one();
+        }
+    }
+
+    bool popOwn(std::size_t index, task_t &task)
+    {
+        auto &worker = *_workers[index];
+        std::lock_guard lk(worker.mtx);
+        if (worker.tasks.empty())
+        {
+            return false;
+        }
+
+        task = std::move(worker.tasks.back());
+        worker.tasks.pop_back();
+        return true;
+    }
+
+    bool popInjected(task_t &task)
+    {
+        std::lock_guard lk(_injectedMtx);
+        if (_injected.empty())
+        {
+            return false;
+        }
+
+        task = std::move(_injected.front());
+        _injected.pop_front();
+        return true;
+    }
+
+    bool popFair(task_t &task, std::shared_ptr<Tenant> &tenant)
+    {
+        std::lock_guard lk(_ringMtx);
+        while (!_ring.empty())
+        {
+            auto &front = _ring.front();
+            if (front->deficit <= 0)
+            {
+                // Credit the tenant for the next round and serve the others.
+                front->deficit +=
+                    kQuantumNs * static_cast<std::int64_t>(front->weight);
+                _ring.push_back(std::move(front));
+                _ring.pop_front();
+                continue;
+            }
+
+            tenant = front;
+            task = std::move(tenant->tasks.front());
+            tenant->tasks.pop_front();
+            if (tenant->tasks.empty())
+            {
+                // Idle tenants keep their debt, but don't save up credit.
+                tenant->active = false;
+                tenant->deficit = std::min<std::int64_t>(0, tenant->deficit);
+                _ring.pop_front();
+            }
+            return true;
+        }
+
+        return false;
+    }
+
+    void charge(Tenant &tenant, std::uint64_t ns)
+    {
+        tenant.cpuNs.fetch_add(ns);
+        std::lock_guard lk(_ringMtx);
+        tenant.deficit -= static_cast<std::int64_t>(ns);
+    }
+
+    bool steal(std::size_t thief, task_t &task)
+    {
+        for (std::size_t i(1); i < _workers.size(); ++i)
+        {
+            auto &victim = *_workers[(thief + i) % _workers.size()];
+            std::lock_guard lk(victim.mtx);
+            if (!victim.tasks.empty())
+            {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void work(std::size_t index)
+    {
+        tl_pool = this;
+        tl_index = index;
+
+        task_t task;
+        std::shared_ptr<Tenant> tenant;
+        while (true)
+        {
+            if (popOwn(index, task) || popFair(task, tenant) ||
+                popInjected(task) || steal(index, task))
+            {
+                _pending.fetch_sub(1);
+                run(task, tenant);
+                continue;
+            }
+
+            std::unique_lock lk(_sleepMtx);
+            _sleepers.fetch_add(1);
+            _wake.wait(lk, [this] { return _closing || _pending.load(); });
+            _sleepers.fetch_sub(1);
+
+            if (_closing && !_pending.load())
+            {
+                return;
+            }
+        }
+    }
+};
+
+} // namespace detail
+
+template <class... Ts> class Pipeline;
+
+/**
+ * @brief Bounded set of threads that runs the stages of any number of
+ * pipelines. Copies of an executor share the same threads, which exit when
+ * the last copy, and the last pipeline constructed against it, is destroyed.
+ * Pipelines get a share of the threads proportional to their weight, so that
+ * a heavy pipeline cannot starve the rest.
+ */
+class Executor
+{
+    template <class...> friend class Pipeline;
+
+    std::shared_ptr<detail::WorkStealingPool> _pool;
+    std::size_t _weight{1};
+
+  public:
+    explicit Executor(
+        std::size_t threads = std::thread::hardware_concurrency())
+        : _pool(std::make_shared<detail::WorkStealingPool>(threads))
+    {
+    }
+
+    /**
+     * @brief An executor without threads of its own, whose tasks run on an
+     * existing thread pool. The scheduling function submits a task to that
+     * pool, e.g. for a P2300 scheduler:
+     *
+     *     yap::Executor ex([sch](std::function<void()> task) {
+     *         stdexec::start_detached(stdexec::schedule(sch) |
+     *                                 stdexec::then(std::move(task)));
+     *     });
+     *
+     * Tasks must not block on each other, so a pool of a single thread runs
+     * any number of pipelines.
+     */
+    explicit Executor(detail::WorkStealingPool::scheduler_t schedule)
+        : _pool(std::make_shared<detail::WorkStealingPool>(std::move(schedule)))
+    {
+    }
+
+    // Threads of the executor, zero when running on a foreign pool.
+    std::size_t size() const noexcept
+    {
+        return _pool->size();
+    }
+
+    std::size_t weight() const noexcept
+    {
+        return _weight;
+    }
+
+    /**
+     * @brief A handle to the same threads, for pipelines that get a share of
+     * them proportional to the given weight. The default weight is 1.
+     */
+    Executor weighted(std::size_t weight) const
+    {
+        Executor ret(*this);
+        ret._weight = std::max<std::size_t>(1, weight);
+        return ret;
+    }
+};
+
+} // namespace yap
@@ -0,0 +1,151 @@
+// © 2022 Nikolaos Athanasiou, github.com/picanumber
+#pragma once
+
+#include "runtime_utilities.h"
+#include "stage_context.h"
+
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace yap
+{
+
+namespace detail
+{
+
+template <std::size_t I, class Ops, class... Args> struct chain_result
+{
+    using op_t = std::tuple_element_t<I, Ops>;
+    using type = op_result_t<op_t, Args...>;
+};
+
+template <std::size_t I, class Ops, class... Args>
+    requires(I + 1 < std::tuple_size_v<Ops>)
+struct chain_result<I, Ops, Args...>
+{
+    using op_t = std::tuple_element_t<I, Ops>;
+    using out_t = op_result_t<op_t, Args...>;
+    static_assert(!std::is_void_v<out_t>,
+                  "Only the last operation of a fused stage can be a sink");
+
+    using type = typename chain_result<I + 1, Ops, out_t>::type;
+};
+
+} // namespace detail
+
+/**
+ * @brief A chain of operations that runs as a single pipeline stage. Each
+ * output of an operation is handed directly to the next one, instead of going
+ * through a buffer and a thread switch. Within the chain, operations keep the
+ * semantics they have as separate stages, i.e. filtering operations may drop
+ * items and hatching operations may produce multiple outputs per input.
+ *
+ * @tparam Fs Operations in data flow order.
+ */
+template <class... Fs> class Fused
+{
+    static_assert(sizeof...(Fs) > 0, "Nothing to fuse");
+
+    template <class... Gs> friend class Fused;
+
+    std::tuple<Fs...> _ops;
+
+  public:
+    using emitting_tag = void;
+
+    template <class... Args>
+    using output_t =
+        typename detail::chain_result<0, std::tuple<Fs...>, Args...>::type;
+
+    explicit Fused(Fs... ops) : _ops(std::move(ops)...)
+    {
+    }
+
+    explicit Fused(std::tuple<Fs...> ops) : _ops(std::move(ops))
+    {
+    }
+
+    /**
+     * @brief Process an input, or produce from a generator if no input is
+     * given, passing the outputs of the last operation to emit.
+     */
+    template <class E, class... Args>
+    void feed(StageContext &ctx, E &&emit, Args &&...args)
+    {
+        feedFrom<0>(ctx, emit, std::forward<Args>(args)...);
+    }
+
+    /**
+     * @brief Extend the chain with one more operation.
+     */
+    template <class G> friend auto operator|(Fused &&fused, G &&op)
+    {
+        return Fused<Fs..., std::decay_t<G>>(std::tuple_cat(
+            std::move(fused._ops),
+            std::tuple<std::decay_t<G>>(std::forward<G>(op))));
+    }
+
+    template <class G> friend auto operator|(Fused const &fused, G &&op)
+    {
+        return Fused(fused) | std::forward<G>(op);
+    }
+
+    // Hooks of the chained operations run in data flow order.
+    void on_start()
+        requires(detail::start_hook<Fs> || ...)
+    {
+        std::apply([](auto &...ops) { (detail::startHook(ops), ...); }, _ops);
+    }
+
+    void on_stop()
+        requires(detail::stop_hook<Fs> || ...)
+    {
+        std::apply([](auto &...ops) { (detail::stopHook(ops), ...); }, _ops);
+    }
+
+    void on_barrier()
+        requires(detail::barrier_hook<Fs> || ...)
+    {
+        std::apply([](auto &...ops) { (detail::barrierHook(ops), ...); },
+                   _ops);
+    }
+
+  private:
+    template <std::size_t I, class E, class... Args>
+    void feedFrom(StageContext &ctx, E &emit, Args &&...args)
+    {
+        auto &op = std::get<I>(_ops);
+        if constexpr (I + 1 == sizeof...(Fs))
+        {
+            detail::apply_op(op, ctx, emit, std::forward<Args>(args)...);
+        }
+        else
+        {
+            auto next = [this, &ctx, &emit](auto &&result) {
+                feedFrom<I + 1>(ctx, emit, std::move(result));
+            };
+            detail::apply_op(op, ctx, next, std::forward<Args>(args)...);
+        }
+    }
+};
+
+/**
+ * @brief Fuse consecutive operations into a single stage, to avoid paying
+ * for buffering and synchronization between lightweight stages. The fused
+ * stage is placed in a pipeline like any other operation:
+ *
+ *     auto pl = Pipeline{} | gen | Fuse(parse, validate, enrich) | sink;
+ *
+ * A fused stage can be extended with "|" only outside of a pipeline
+ * expression, or within parentheses, since "|" binds left to right:
+ *
+ *     auto pl = Pipeline{} | gen | (Fuse(parse) | validate) | sink;
+ */
+template <class... Fs> auto Fuse(Fs &&...ops)
+{
+    return Fused<std::decay_t<Fs>...>(std::forward<Fs>(ops)...);
+}
+
+} // namespace yap
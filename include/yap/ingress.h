@@ -0,0 +1,39 @@
+// © 2022 Nikolaos Athanasiou, github.com/picanumber
+#pragma once
+
+#include "runtime_utilities.h"
+
+#include <cstddef>
+
+namespace yap
+{
+
+/**
+ * @brief Selects a pipeline without a generator stage, whose input is pushed
+ * by threads the pipeline doesn't own, e.g. network callbacks. Items go
+ * straight into the buffer of the first stage, which holds up to capacity
+ * items before pushing reports backpressure.
+ *
+ * @tparam T Type of the pushed items.
+ */
+template <class T> struct Ingress
+{
+    std::size_t capacity = 1024; // Zero for an unbounded buffer.
+};
+
+namespace detail
+{
+
+// Stands in for the generator of a pipeline with pushed input. Invoking it
+// ends the stream, which only synchronous consumption does.
+template <class T> struct Inlet
+{
+    T operator()() const
+    {
+        throw GeneratorExit{};
+    }
+};
+
+} // namespace detail
+
+} // namespace yap
@@ -0,0 +1,155 @@
+// © 2022 Nikolaos Athanasiou, github.com/picanumber
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <memory>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+
+namespace yap
+{
+
+namespace detail
+{
+
+struct CacheStats
+{
+    std::atomic_size_t hits{0};
+    std::atomic_size_t misses{0};
+};
+
+} // namespace detail
+
+/**
+ * @brief A stage operation that caches its results in a bounded LRU cache.
+ *
+ * @details Inputs found in the cache skip the wrapped operation and produce a
+ * copy of the cached output. When the cache is full, the least recently used
+ * entry is evicted. Copies of a memoized operation start with an empty cache
+ * but share the hit/miss counters, so a handle kept by the user observes the
+ * copy placed in the pipeline.
+ *
+ * @tparam IN Input type of the wrapped operation. Used as the cache key.
+ * @tparam F Type of the wrapped operation.
+ * @tparam Hash Hash function for inputs.
+ * @tparam Eq Equality comparison for inputs.
+ */
+template <class IN, class F, class Hash, class Eq> class Memoized
+{
+  public:
+    using result_t = std::invoke_result_t<F &, IN>;
+
+  private:
+    using entry_t = std::pair<IN const, result_t>;
+    using list_t = std::list<entry_t>;
+    using key_t = std::reference_wrapper<IN const>;
+
+    struct KeyHash
+    {
+        Hash hash;
+        std::size_t operator()(key_t key) const
+        {
+            return hash(key.get());
+        }
+    };
+
+    struct KeyEq
+    {
+        Eq eq;
+        bool operator()(key_t lhs, key_t rhs) const
+        {
+            return eq(lhs.get(), rhs.get());
+        }
+    };
+
+    F _op;
+    std::size_t _capacity;
+    list_t _entries; // Most recently used first.
+    std::unordered_map<key_t, typename list_t::iterator, KeyHash, KeyEq>
+        _index;
+    std::shared_ptr<detail::CacheStats> _stats;
+
+  public:
+    Memoized(F op, std::size_t capacity, Hash hash, Eq eq)
+        : _op(std::move(op)), _capacity(capacity),
+          _index(capacity, KeyHash{std::move(hash)}, KeyEq{std::move(eq)}),
+          _stats(std::make_shared<detail::CacheStats>())
+    {
+    }
+
+    // The index refers to list nodes, so copies start with an empty cache.
+    Memoized(Memoized const &other)
+        : _op(other._op), _capacity(other._capacity),
+          _index(other._capacity, other._index.hash_function(),
+                 other._index.key_eq()),
+          _stats(other._stats)
+    {
+    }
+
+    Memoized(Memoized &&other) = default;
+    Memoized &operator=(Memoized const &) = delete;
+    Memoized &operator=(Memoized &&) = delete;
+
+    result_t operator()(IN input)
+    {
+        if (auto it = _index.find(std::cref(input)); it != _index.end())
+        {
+            _stats->hits.fetch_add(1, std::memory_order_relaxed);
+            _entries.splice(_entries.begin(), _entries, it->second);
+            return it->second->second;
+        }
+
+        _stats->misses.fetch_add(1, std::memory_order_relaxed);
+        if (0 == _capacity)
+        {
+            return std::invoke(_op, std::move(input));
+        }
+
+        result_t output = std::invoke(_op, IN{input});
+
+        if (_entries.size() == _capacity)
+        {
+            _index.erase(std::cref(_entries.back().first));
+            _entries.pop_back();
+        }
+        _entries.emplace_front(std::move(input), output);
+        _index.emplace(std::cref(_entries.front().first), _entries.begin());
+
+        return output;
+    }
+
+    std::size_t hits() const noexcept
+    {
+        return _stats->hits.load(std::memory_order_relaxed);
+    }
+
+    std::size_t misses() const noexcept
+    {
+        return _stats->misses.load(std::memory_order_relaxed);
+    }
+};
+
+/**
+ * @brief Wrap a stage operation into a bounded LRU cache of input to output
+ * pairs, so that repeated inputs skip the operation.
+ *
+ * @tparam IN Input type of the operation. Has to be specified. Inputs must be
+ * copyable, as well as the outputs of the operation.
+ * @param op The operation to memoize.
+ * @param capacity Maximum number of cached input/output pairs.
+ * @param hash Hash function for inputs.
+ * @param eq Equality comparison for inputs.
+ */
+template <class IN, class F, class Hash = std::hash<IN>,
+          class Eq = std::equal_to<IN>>
+auto Memoize(F op, std::size_t capacity, Hash hash = {}, Eq eq = {})
+{
+    return Memoized<IN, F, Hash, Eq>(std::move(op), capacity, std::move(hash),
+                                     std::move(eq));
+}
+
+} // namespace yap
@@ -1,13 +1,29 @@
 // © 2022 Nikolaos Athanasiou, github.com/picanumber
 #pragma once
 
+#include "auto_fuse.h"
 #include "buffer_queue.h"
+#include "executor.h"
+#include "ingress.h"
 #include "pipeline_types_utilities.h"
+#include "request.h"
+#include "results.h"
 #include "stage.h"
+#include "stage_context.h"
+#include "tokens.h"
 
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <functional>
 #include <memory>
 #include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
 #include <tuple>
+#include <type_traits>
+#include <vector>
 
 namespace yap
 {
@@ -19,6 +35,63 @@ enum class ReturnValue : uint8_t
     NoOp
 };
 
+/**
+ * @brief Requests processing on the calling thread, by driving all stages in
+ * a loop, instead of spawning threads.
+ */
+struct Synchronous
+{
+};
+
+/**
+ * @brief Requests run to return once every stage has invoked the start hook
+ * of its operation, so that the first items don't pay for the warm-up.
+ */
+struct Warm
+{
+};
+
+/**
+ * @brief Expected number of items to process. Jobs no larger than the
+ * synchronous limit are processed on the calling thread, since starting
+ * threads would cost more than the work itself.
+ */
+struct SizeHint
+{
+    std::size_t items;
+    std::size_t synchronousLimit = 1024;
+};
+
+class pipeline;
+
+/**
+ * @brief Awaits the consumption of a pipeline without blocking a thread, and
+ * produces the result of consume. Being awaitable, it's also a sender for
+ * libraries that implement P2300.
+ */
+class ConsumeAwaiter
+{
+    pipeline &_pl;
+    ReturnValue _ret{ReturnValue::NoOp};
+
+  public:
+    explicit ConsumeAwaiter(pipeline &pl) : _pl(pl)
+    {
+    }
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    void await_suspend(std::coroutine_handle<> h);
+
+    ReturnValue await_resume() const noexcept
+    {
+        return _ret;
+    }
+};
+
 /**
  * @brief Parallel data processing pipeline
  * - with one thread per stage,
@@ -42,6 +115,14 @@ class pipeline
      */
     virtual ReturnValue run() = 0;
 
+    /**
+     * @brief Start data processing and wait until every stage is warm, i.e.
+     * has invoked the "on_start" hook of its operation, if any.
+     *
+     * @return A member of the ReturnValue enumeration.
+     */
+    virtual ReturnValue run(Warm) = 0;
+
     /**
      * @brief Ceases all processing stages and clears data left in the
      * intermediate buffers. Subsequent "run" commands will start fresh.
@@ -65,8 +146,71 @@ class pipeline
      * @return A member of the ReturnValue enumeration.
      */
     virtual ReturnValue consume() = 0;
+
+    /**
+     * @brief Process all generated data on the calling thread. Only idle or
+     * paused pipelines can be consumed synchronously. Data left in the
+     * intermediate buffers from a paused run is processed first.
+     *
+     * @return A member of the ReturnValue enumeration.
+     */
+    virtual ReturnValue consume(Synchronous) = 0;
+
+    /**
+     * @brief Process all generated data, on the calling thread if the job is
+     * small according to the hint.
+     *
+     * @return A member of the ReturnValue enumeration.
+     */
+    virtual ReturnValue consume(SizeHint hint) = 0;
+
+    /**
+     * @brief CPU time that executor threads spent processing the stages of a
+     * pipeline constructed against a shared executor. Zero in other modes.
+     */
+    virtual std::chrono::nanoseconds cpuTime() const = 0;
+
+    /**
+     * @brief Process all generated data, like consume, without blocking the
+     * calling thread. Invokes done with the result, on a thread of the
+     * executor when it runs on a foreign pool, or on a thread that waits for
+     * the stages otherwise. Stopping or pausing the pipeline first completes
+     * the consumption with ReturnValue::NoOp. The pipeline must outlive it.
+     */
+    virtual void consumeThen(std::function<void(ReturnValue)> done) = 0;
+
+    /**
+     * @brief Send a barrier through the stages, behind the data generated or
+     * pushed so far. Every stage invokes the "on_barrier" hook of its
+     * operation, if any, once the data ahead of the barrier went through it,
+     * e.g. to emit partial aggregates or commit a checkpoint. The generator
+     * is ahead of the barrier, so its hook isn't invoked.
+     *
+     * @return A future that becomes ready once the barrier passes the sink,
+     * or is pulled from the results of a pipeline without one. Stopping the
+     * pipeline before then breaks the promise.
+     */
+    virtual std::future<void> flush() = 0;
+
+    /**
+     * @brief Awaitable form of consumeThen:
+     *
+     *     auto res = co_await pl.consumeAsync();
+     */
+    ConsumeAwaiter consumeAsync()
+    {
+        return ConsumeAwaiter(*this);
+    }
 };
 
+inline void ConsumeAwaiter::await_suspend(std::coroutine_handle<> h)
+{
+    _pl.consumeThen([this, h](ReturnValue ret) {
+        _ret = ret;
+        h.resume();
+    });
+}
+
 /**
  * @brief Realization of the parallel data processing pipeline, for arbitrary
  * combinations of data transformations over arbitrary stages.
@@ -84,23 +228,107 @@ template <class... Ts> class Pipeline : public pipeline
         Paused
     };
 
+    // Output of the last stage, void unless the pipeline has no sink.
+    using result_t = typename std::conditional_t<
+        sizeof...(Ts), last_type<Ts...>, std::type_identity<void>>::type;
+
   public:
     Pipeline() = default;
+    explicit Pipeline(WorkStealing mode);
+    explicit Pipeline(Executor executor);
+    explicit Pipeline(AutoFuse mode);
+    explicit Pipeline(Tokens mode);
+    explicit Pipeline(InlineHandoff mode);
+    template <class T> explicit Pipeline(Ingress<T> mode);
+    template <class T> explicit Pipeline(Requests<T> mode);
     template <class F, class... Us> Pipeline(Pipeline<Us...> &&pl, F &&fun);
     Pipeline(Pipeline<Ts...> &&other);
 
     ~Pipeline() override;
 
     ReturnValue run() override;
+    ReturnValue run(Warm) override;
     ReturnValue stop() override;
     ReturnValue pause() override;
     ReturnValue consume() override;
+    ReturnValue consume(Synchronous) override;
+    ReturnValue consume(SizeHint hint) override;
+    std::chrono::nanoseconds cpuTime() const override;
+    void consumeThen(std::function<void(ReturnValue)> done) override;
+    std::future<void> flush() override;
+
+    /**
+     * @brief Replace the operation of stage I, e.g. to roll out a new model
+     * or rule set, without stopping. The stage switches between items and the
+     * other stages keep processing. The replacement must produce the same
+     * output type and keep the Stateless marker, if any.
+     */
+    template <std::size_t I, class F> void replace(F &&operation);
+
+    /**
+     * @brief Run a pipeline without a sink, unless it's running already, and
+     * pull the outputs of its last stage as an input range. The range ends
+     * with the stream, leaving the pipeline idle.
+     */
+    Results<result_t> results();
+
+    /**
+     * @brief Push an item into the first stage of a pipeline constructed
+     * with yap::Ingress, waiting while its buffer is full. Items pushed while
+     * the pipeline doesn't run are processed once it does. Consuming the
+     * pipeline ends the stream after the items pushed so far.
+     *
+     * @return Ok once the item is buffered, or Error, leaving the item
+     * untouched, while the pipeline is being stopped or paused.
+     */
+    template <class U> ReturnValue push(U &&item);
+
+    /**
+     * @brief Push an item without waiting.
+     *
+     * @return Ok once the item is buffered, or NoOp, leaving the item
+     * untouched, if the buffer is full. Error as in push.
+     */
+    template <class U> ReturnValue tryPush(U &&item);
+
+    /**
+     * @brief Push an item, waiting at most timeout for room.
+     *
+     * @return Ok once the item is buffered, or NoOp, leaving the item
+     * untouched, if the buffer stayed full. Error as in push.
+     */
+    template <class U, class Rep, class Period>
+    ReturnValue pushFor(U &&item, std::chrono::duration<Rep, Period> timeout);
+
+    /**
+     * @brief Submit a request to a pipeline constructed with yap::Requests,
+     * waiting while its buffer is full, and get a response that completes
+     * with the output of the last stage for this request. Requests dropped
+     * along the way, e.g. by a filter or by stopping the pipeline, fail with
+     * a broken promise.
+     */
+    template <class U> auto submit(U &&request);
 
   private:
     template <class...> friend class Pipeline;
 
     ReturnValue runImpl();
     ReturnValue ceaseProcessing();
+    StageContext makeContext();
+    template <std::size_t I> auto inputOf() const;
+    template <std::size_t I> auto outputOf() const;
+    template <std::size_t I> void drain();
+    void bindFusion();
+    bool carryToken();
+    void warmUp();
+    void coolDown();
+    void openResults();
+    ReturnValue finishConsume(std::uint64_t run);
+    void endIngress();
+    template <class W> ReturnValue ingest(W &&push);
+    template <std::size_t I, class T>
+    bool carry(std::uint64_t seq, std::vector<T> batch,
+               detail::Barrier const *barrier = nullptr);
 
   private:
     using buffers_t = buffer_list_t<Ts...>;
@@ -108,11 +336,67 @@ template <class... Ts> class Pipeline : public pipeline
 
     buffers_t _buffers;
     stages_t _stages;
+    std::shared_ptr<detail::WorkerPool> _pool;
+    std::shared_ptr<detail::WorkStealingPool> _executor;
+    std::shared_ptr<detail::Tenant> _tenant;
+    std::shared_ptr<detail::FusionController> _fusion;
+    std::shared_ptr<detail::TokenCrew> _crew;
+    bool _handoffWhenIdle{false};
+    std::shared_ptr<BufferQueue<std::future<result_t>>> _results;
+    std::optional<std::size_t> _ingress; // Capacity of the pushed buffer.
+    std::shared_ptr<detail::PushListener> _completer;
 
     mutable std::mutex _cmdMtx;
     State _state{State::Idle};
+    std::uint64_t _runs{0};
 };
 
+template <class... Ts>
+Pipeline<Ts...>::Pipeline(WorkStealing mode)
+    : _executor(std::make_shared<detail::WorkStealingPool>(mode.threads))
+{
+}
+
+template <class... Ts>
+Pipeline<Ts...>::Pipeline(Executor executor)
+    : _executor(std::move(executor._pool)),
+      _tenant(std::make_shared<detail::Tenant>(executor._weight))
+{
+}
+
+template <class... Ts>
+Pipeline<Ts...>::Pipeline(AutoFuse mode)
+    : _fusion(std::make_shared<detail::FusionController>(std::move(mode)))
+{
+}
+
+template <class... Ts>
+Pipeline<Ts...>::Pipeline(Tokens mode)
+    : _crew(std::make_shared<detail::TokenCrew>(mode.count))
+{
+}
+
+template <class... Ts>
+Pipeline<Ts...>::Pipeline(InlineHandoff) : _handoffWhenIdle(true)
+{
+}
+
+template <class... Ts>
+template <class T>
+Pipeline<Ts...>::Pipeline(Ingress<T> mode)
+    : _stages(std::make_tuple(std::make_unique<Stage<void, T>>(
+          detail::Inlet<T>{}))),
+      _ingress(mode.capacity)
+{
+}
+
+template <class... Ts>
+template <class T>
+Pipeline<Ts...>::Pipeline(Requests<T> mode)
+    : Pipeline(Ingress<detail::Tagged<T>>{mode.capacity})
+{
+}
+
 template <class... Ts>
 template <class F, class... Us>
 Pipeline<Ts...>::Pipeline(Pipeline<Us...> &&pl, F &&fun)
@@ -120,7 +404,11 @@ Pipeline<Ts...>::Pipeline(Pipeline<Us...> &&pl, F &&fun)
           std::move(pl._stages),
           std::make_tuple(
               std::make_unique<typename detail::last_type_impl<
-                  stages_t>::type::element_type>(std::forward<F>(fun)))))
+                  stages_t>::type::element_type>(std::forward<F>(fun))))),
+      _executor(std::move(pl._executor)), _tenant(std::move(pl._tenant)),
+      _fusion(std::move(pl._fusion)),
+      _crew(std::move(pl._crew)), _handoffWhenIdle(pl._handoffWhenIdle),
+      _ingress(pl._ingress)
 {
     if constexpr (std::tuple_size_v<buffers_t>)
     {
@@ -129,6 +417,13 @@ Pipeline<Ts...>::Pipeline(Pipeline<Us...> &&pl, F &&fun)
             std::make_tuple(std::make_shared<typename detail::last_type_impl<
                                 buffers_t>::type::element_type>()));
     }
+    if constexpr (1 == std::tuple_size_v<buffers_t>)
+    {
+        if (_ingress)
+        {
+            std::get<0>(_buffers)->limit(*_ingress);
+        }
+    }
 }
 
 template <class... Ts> Pipeline<Ts...>::Pipeline(Pipeline<Ts...> &&other)
@@ -137,7 +432,17 @@ template <class... Ts> Pipeline<Ts...>::Pipeline(Pipeline<Ts...> &&other)
 
     _buffers.swap(other._buffers);
     _stages.swap(other._stages);
+    _pool.swap(other._pool);
+    _executor.swap(other._executor);
+    _tenant.swap(other._tenant);
+    _fusion.swap(other._fusion);
+    _crew.swap(other._crew);
+    std::swap(_handoffWhenIdle, other._handoffWhenIdle);
+    _results.swap(other._results);
+    _ingress.swap(other._ingress);
+    _completer.swap(other._completer);
     std::swap(_state, other._state);
+    std::swap(_runs, other._runs);
 }
 
 template <class... Ts> Pipeline<Ts...>::~Pipeline()
@@ -145,47 +450,207 @@ template <class... Ts> Pipeline<Ts...>::~Pipeline()
     stop();
 }
 
+template <class... Ts> StageContext Pipeline<Ts...>::makeContext()
+{
+    if (!_pool)
+    {
+        // Data parallel work uses the cores not already taken by stages.
+        constexpr std::size_t nStages = std::tuple_size_v<stages_t>;
+        std::size_t nCores = std::thread::hardware_concurrency();
+
+        _pool = std::make_shared<detail::WorkerPool>(
+            nCores > nStages ? nCores - nStages : 0);
+    }
+
+    return StageContext(_pool);
+}
+
+template <class... Ts> void Pipeline<Ts...>::bindFusion()
+{
+    if (!_fusion || _fusion->bound())
+    {
+        return;
+    }
+
+    std::vector<std::function<void(bool)>> links;
+    std::apply(
+        [&links](auto &...buffers) {
+            (links.emplace_back(
+                 [buffer = buffers.get()](bool on) { buffer->handoff(on); }),
+             ...);
+        },
+        _buffers);
+    _fusion->bind(std::tuple_size_v<stages_t>, std::move(links));
+
+    std::apply(
+        [this](auto &...stages) {
+            std::size_t i = 0;
+            (stages->probe(_fusion.get(), _fusion->profile(i++)), ...);
+        },
+        _stages);
+}
+
+// Buffer a stage pops from, or null for the generator.
+template <class... Ts>
+template <std::size_t I>
+auto Pipeline<Ts...>::inputOf() const
+{
+    if constexpr (0 == I)
+    {
+        return nullptr;
+    }
+    else
+    {
+        return std::get<I - 1>(_buffers);
+    }
+}
+
+// Buffer a stage pushes to, i.e. the results buffer or null for the last.
+template <class... Ts>
+template <std::size_t I>
+auto Pipeline<Ts...>::outputOf() const
+{
+    if constexpr (I + 1 == std::tuple_size_v<stages_t>)
+    {
+        return _results;
+    }
+    else
+    {
+        return std::get<I>(_buffers);
+    }
+}
+
+template <class... Ts> bool Pipeline<Ts...>::carryToken()
+{
+    using generated_t = std::tuple_element_t<1, std::tuple<Ts...>>;
+
+    std::vector<generated_t> batch;
+    std::uint64_t seq = 0;
+    std::optional<detail::Barrier> barrier;
+    auto generate = [this, &batch] {
+        return std::get<0>(_stages)->generate(batch);
+    };
+    if (!_crew->generate(generate, seq, barrier))
+    {
+        return false;
+    }
+
+    if (!carry<1>(seq, std::move(batch), barrier ? &*barrier : nullptr))
+    {
+        _crew->exhaust();
+    }
+    return true;
+}
+
+template <class... Ts>
+template <std::size_t I, class T>
+bool Pipeline<Ts...>::carry(std::uint64_t seq, std::vector<T> batch,
+                            detail::Barrier const *barrier)
+{
+    auto &stage = std::get<I>(_stages);
+    if constexpr (I + 1 == std::tuple_size_v<stages_t>)
+    {
+        bool keepProcessing;
+        if constexpr (std::is_void_v<result_t>)
+        {
+            keepProcessing = stage->serve(
+                seq, std::move(batch), [](auto &&) {}, barrier);
+            if (barrier)
+            {
+                barrier->pass();
+            }
+        }
+        else
+        {
+            keepProcessing = stage->serve(
+                seq, std::move(batch),
+                [this](result_t &&item) {
+                    _results->push(
+                        make_ready_future<result_t>(std::move(item)));
+                },
+                barrier);
+            if (barrier)
+            {
+                _results->push(make_exceptional_future<result_t>(*barrier));
+            }
+        }
+        return keepProcessing;
+    }
+    else
+    {
+        using out_t = std::tuple_element_t<2 * I + 1, std::tuple<Ts...>>;
+
+        std::vector<out_t> outputs;
+        bool keepProcessing = stage->serve(
+            seq, std::move(batch),
+            [&outputs](out_t &&item) { outputs.push_back(std::move(item)); },
+            barrier);
+
+        // Downstream stages serve the token even if it carries nothing, so
+        // that serial stages see every sequence number.
+        return carry<I + 1>(seq, std::move(outputs), barrier) &&
+               keepProcessing;
+    }
+}
+
 template <class... Ts> ReturnValue Pipeline<Ts...>::runImpl()
 {
     auto ret = ReturnValue::NoOp;
 
     if (State::Idle == _state || State::Paused == _state)
     {
+        openResults();
+        bindFusion();
+        if (_handoffWhenIdle && !_executor)
+        {
+            std::apply(
+                [](auto &...stages) { (stages->handoffWhenIdle(true), ...); },
+                _stages);
+        }
+
         auto startStages = [this]<std::size_t... Is>(std::index_sequence<Is...>)
         {
-            [[maybe_unused]] auto startStage =
-                [this]<std::size_t I>(std::integral_constant<std::size_t, I>) {
-                    // A running pipeline has at least a generator and a sink.
-                    if constexpr (sizeof...(Ts) >= 4)
-                    {
-                        if constexpr (0 == I)
-                        {
-                            std::get<0>(_stages)->start(nullptr,
-                                                        std::get<0>(_buffers));
-                        }
-                        else if constexpr (I == std::tuple_size_v<stages_t> - 1)
-                        {
-                            constexpr auto nBuffers =
-                                std::tuple_size_v<buffers_t>;
-                            std::get<I>(_stages)->start(
-                                std::get<nBuffers - 1>(_buffers), nullptr);
-                        }
-                        else
-                        {
-                            std::get<I>(_stages)->start(
-                                std::get<I - 1>(_buffers),
-                                std::get<I>(_buffers));
-                        }
-                    }
-                    (void)this;
-                };
-
-            (startStage(std::integral_constant<std::size_t, Is>{}), ...);
+            // A running pipeline has at least a generator and a sink. Pushed
+            // input takes the place of the generator.
+            if constexpr (sizeof...(Ts) >= 4)
+            {
+                ((0 == Is && _ingress
+                      ? void()
+                      : std::get<Is>(_stages)->start(
+                            inputOf<Is>(), outputOf<Is>(), makeContext(),
+                            _executor.get(), _tenant)),
+                 ...);
+            }
+            (void)this;
         };
 
-        startStages(std::make_index_sequence<std::tuple_size_v<stages_t>>{});
+        if (_crew)
+        {
+            if constexpr (sizeof...(Ts) >= 4)
+            {
+                std::apply(
+                    [](auto &...stages) { (stages->adoptReplacement(), ...); },
+                    _stages);
+                warmUp(); // Tokens visit every stage, so hooks run here.
+                std::function<void()> ended;
+                if constexpr (!std::is_void_v<result_t>)
+                {
+                    ended = [results = _results] {
+                        results->push(
+                            make_exceptional_future<result_t>(GeneratorExit{}));
+                    };
+                }
+                _crew->start([this] { return carryToken(); }, ended);
+            }
+        }
+        else
+        {
+            startStages(
+                std::make_index_sequence<std::tuple_size_v<stages_t>>{});
+        }
 
         _state = State::Running;
+        ++_runs;
         ret = ReturnValue::Ok;
     }
 
@@ -200,13 +665,34 @@ template <class... Ts> ReturnValue Pipeline<Ts...>::ceaseProcessing()
     {
         if constexpr (std::tuple_size_v<buffers_t>)
         {
-            auto stoppers = std::apply(
-                [](auto &...args) { return std::array{args->stop()...}; },
-                _stages);
+            if (_crew)
+            {
+                // Tokens in flight are carried through the last stage.
+                _crew->stop();
+                coolDown();
+            }
+            else
+            {
+                if (_executor)
+                {
+                    // Halting in data flow order guarantees that no stage
+                    // gets scheduled by an upstream one after settling.
+                    std::apply([](auto &...args) { (args->halt(), ...); },
+                               _stages);
+                }
 
-            std::apply(
-                [](auto &...args) { (args->set(BufferBehavior::Closed), ...); },
-                _buffers);
+                // Request every stage to stop before waiting on any, so that
+                // stopping takes as long as the slowest stage.
+                std::apply([](auto &...args) { (args->stop(), ...); },
+                           _stages);
+                std::apply(
+                    [](auto &...args) {
+                        (args->set(BufferBehavior::Closed), ...);
+                    },
+                    _buffers);
+                std::apply([](auto &...args) { (args->halt(), ...); },
+                           _stages);
+            }
 
             ret = ReturnValue::Ok;
         }
@@ -221,6 +707,18 @@ template <class... Ts> ReturnValue Pipeline<Ts...>::run()
     return runImpl();
 }
 
+template <class... Ts> ReturnValue Pipeline<Ts...>::run(Warm)
+{
+    std::lock_guard lk(_cmdMtx);
+    auto ret = runImpl();
+    if (State::Running == _state)
+    {
+        std::apply([](auto &...stages) { (stages->awaitWarm(), ...); },
+                   _stages);
+    }
+    return ret;
+}
+
 template <class... Ts> ReturnValue Pipeline<Ts...>::stop()
 {
     std::lock_guard lk(_cmdMtx);
@@ -233,6 +731,20 @@ template <class... Ts> ReturnValue Pipeline<Ts...>::stop()
                 ((args->clear(), args->set(BufferBehavior::WaitOnEmpty)), ...);
             },
             _buffers);
+        if constexpr (!std::is_void_v<result_t>)
+        {
+            if (_results)
+            {
+                // Ends the range of results, if one is pulled.
+                _results->clear();
+                _results->push(
+                    make_exceptional_future<result_t>(GeneratorExit{}));
+            }
+        }
+        if (_crew)
+        {
+            _crew->dropBarriers();
+        }
 
         _state = State::Idle;
     }
@@ -259,6 +771,21 @@ template <class... Ts> ReturnValue Pipeline<Ts...>::pause()
     return ret;
 }
 
+template <class... Ts>
+template <std::size_t I, class F>
+void Pipeline<Ts...>::replace(F &&operation)
+{
+    static_assert(I < std::tuple_size_v<stages_t>, "No such stage");
+
+    std::lock_guard lk(_cmdMtx);
+    auto &stage = std::get<I>(_stages);
+    stage->replace(std::forward<F>(operation));
+    if (State::Running != _state)
+    {
+        stage->adoptReplacement();
+    }
+}
+
 template <class... Ts> ReturnValue Pipeline<Ts...>::consume()
 {
     auto ret = ReturnValue::NoOp;
@@ -275,7 +802,17 @@ template <class... Ts> ReturnValue Pipeline<Ts...>::consume()
 
     if (ReturnValue::Ok == ret)
     {
-        std::apply([](auto &...args) { (args->consume(), ...); }, _stages);
+        endIngress();
+        if (_crew)
+        {
+            _crew->join();
+            coolDown();
+        }
+        else
+        {
+            std::apply([](auto &...args) { (args->consume(), ...); },
+                       _stages);
+        }
         _state = State::Idle;
         ret = ReturnValue::Ok;
     }
@@ -283,9 +820,301 @@ template <class... Ts> ReturnValue Pipeline<Ts...>::consume()
     return ret;
 }
 
+template <class... Ts>
+void Pipeline<Ts...>::consumeThen(std::function<void(ReturnValue)> done)
+{
+    if constexpr (sizeof...(Ts) >= 4)
+    {
+        if (_executor && _executor->foreign())
+        {
+            std::lock_guard lk(_cmdMtx);
+            runImpl();
+
+            // The sink sees the end of the stream last. Consumption completes
+            // in a task of its own, since the sink task is still running.
+            auto pool = _executor;
+            auto &sink = std::get<std::tuple_size_v<stages_t> - 1>(_stages);
+            sink->whenDone([this, pool, run = _runs, done = std::move(done)] {
+                pool->post([this, run, done] { done(finishConsume(run)); });
+            });
+            return;
+        }
+    }
+
+    // Waiting for threads of the pipeline takes a thread of its own.
+    std::thread([this, done = std::move(done)] { done(consume()); }).detach();
+}
+
+// Commands aren't serialized with flushing, so that a flush issued during
+// consume doesn't wait for the stream to end.
+template <class... Ts> std::future<void> Pipeline<Ts...>::flush()
+{
+    detail::Barrier barrier;
+    auto ret = barrier.completion();
+
+    if constexpr (sizeof...(Ts) >= 4)
+    {
+        if (_crew)
+        {
+            _crew->flush(std::move(barrier));
+        }
+        else
+        {
+            using in_t = std::tuple_element_t<1, std::tuple<Ts...>>;
+            try
+            {
+                std::get<0>(_buffers)->push(
+                    make_exceptional_future<in_t>(std::move(barrier)));
+            }
+            catch (detail::ClosedError &)
+            {
+                // The dropped barrier breaks its promise.
+            }
+        }
+    }
+    else
+    {
+        barrier.pass(); // Nothing to pass through.
+    }
+
+    return ret;
+}
+
+// Complete an asynchronous consumption, unless its run already ceased.
+template <class... Ts>
+ReturnValue Pipeline<Ts...>::finishConsume(std::uint64_t run)
+{
+    std::lock_guard lk(_cmdMtx);
+    if (State::Running != _state || run != _runs)
+    {
+        return ReturnValue::NoOp;
+    }
+
+    if (_crew)
+    {
+        _crew->join();
+        coolDown();
+    }
+    else
+    {
+        std::apply([](auto &...args) { (args->consume(), ...); }, _stages);
+    }
+    _state = State::Idle;
+    return ReturnValue::Ok;
+}
+
+template <class... Ts> auto Pipeline<Ts...>::results() -> Results<result_t>
+{
+    static_assert(!std::is_void_v<result_t> && sizeof...(Ts) >= 4,
+                  "Results are pulled from pipelines without a sink");
+    static_assert(!detail::tagged<result_t>,
+                  "Responses go to the submitters of requests");
+
+    std::lock_guard lk(_cmdMtx);
+    runImpl();
+    return Results<result_t>(_results,
+                             [this, run = _runs] { finishConsume(run); });
+}
+
+// Outputs of a pipeline without a sink are buffered until pulled. A fresh run
+// starts with an empty buffer, while a paused one keeps its results.
+template <class... Ts> void Pipeline<Ts...>::openResults()
+{
+    if constexpr (!std::is_void_v<result_t>)
+    {
+        if (State::Idle == _state || !_results)
+        {
+            _results = std::make_shared<BufferQueue<std::future<result_t>>>();
+            if constexpr (detail::tagged<result_t>)
+            {
+                // Responses complete their requests as soon as they're pushed.
+                _completer = std::make_shared<
+                    detail::Completer<typename result_t::value_type>>(
+                    _results);
+                _results->listen(_completer.get());
+            }
+        }
+    }
+}
+
+// End the stream of pushed input after the items pushed so far.
+template <class... Ts> void Pipeline<Ts...>::endIngress()
+{
+    if constexpr (sizeof...(Ts) >= 4)
+    {
+        if (_ingress)
+        {
+            using in_t = std::tuple_element_t<1, std::tuple<Ts...>>;
+            std::get<0>(_buffers)->push(
+                make_exceptional_future<in_t>(GeneratorExit{}));
+        }
+    }
+}
+
+// Pass a pushed item to the first buffer with push, which returns false if the
+// buffer was full.
+template <class... Ts>
+template <class W>
+ReturnValue Pipeline<Ts...>::ingest(W &&push)
+{
+    static_assert(sizeof...(Ts) >= 4, "Pushed input needs a stage to go to");
+
+    if (!_ingress)
+    {
+        throw std::logic_error("Input is only pushed to pipelines "
+                               "constructed with yap::Ingress");
+    }
+
+    try
+    {
+        return std::forward<W>(push)(*std::get<0>(_buffers))
+                   ? ReturnValue::Ok
+                   : ReturnValue::NoOp;
+    }
+    catch (detail::ClosedError &)
+    {
+        return ReturnValue::Error;
+    }
+}
+
+template <class... Ts>
+template <class U>
+ReturnValue Pipeline<Ts...>::push(U &&item)
+{
+    using in_t = std::tuple_element_t<1, std::tuple<Ts...>>;
+    return ingest([&item](auto &buffer) {
+        buffer.pushMade([&item] {
+            return make_ready_future<in_t>(std::forward<U>(item));
+        });
+        return true;
+    });
+}
+
+template <class... Ts>
+template <class U>
+ReturnValue Pipeline<Ts...>::tryPush(U &&item)
+{
+    return pushFor(std::forward<U>(item), std::chrono::nanoseconds::zero());
+}
+
+template <class... Ts>
+template <class U, class Rep, class Period>
+ReturnValue Pipeline<Ts...>::pushFor(U &&item,
+                                     std::chrono::duration<Rep, Period> timeout)
+{
+    using in_t = std::tuple_element_t<1, std::tuple<Ts...>>;
+    return ingest([&item, timeout](auto &buffer) {
+        return buffer.pushMadeFor(
+            [&item] {
+                return make_ready_future<in_t>(std::forward<U>(item));
+            },
+            timeout);
+    });
+}
+
+template <class... Ts>
+template <class U>
+auto Pipeline<Ts...>::submit(U &&request)
+{
+    static_assert(detail::tagged<result_t>,
+                  "Requests are submitted to pipelines constructed with "
+                  "yap::Requests");
+
+    using in_t = std::tuple_element_t<1, std::tuple<Ts...>>;
+    using completion_t = detail::Completion<typename result_t::value_type>;
+
+    auto completion = std::make_shared<completion_t>();
+    push(in_t{detail::Ticket(completion),
+              typename in_t::value_type(std::forward<U>(request))});
+    return Response(std::move(completion));
+}
+
+// Invoke the start hooks of stages that run on threads of the pipeline.
+template <class... Ts> void Pipeline<Ts...>::warmUp()
+{
+    std::apply([](auto &...stages) { (stages->warmUp(), ...); }, _stages);
+}
+
+template <class... Ts> void Pipeline<Ts...>::coolDown()
+{
+    std::apply([](auto &...stages) { (stages->coolDown(), ...); }, _stages);
+}
+
+// Process the input of stage I and of every stage after it.
+template <class... Ts>
+template <std::size_t I>
+void Pipeline<Ts...>::drain()
+{
+    while (detail::Step::Processed == std::get<I>(_stages)->poll())
+    {
+    }
+
+    if constexpr (I + 1 < std::tuple_size_v<stages_t>)
+    {
+        drain<I + 1>();
+    }
+}
+
+template <class... Ts> ReturnValue Pipeline<Ts...>::consume(Synchronous)
+{
+    auto ret = ReturnValue::NoOp;
+    std::lock_guard lk(_cmdMtx);
+
+    if constexpr (sizeof...(Ts) >= 4)
+    {
+        if (State::Running != _state)
+        {
+            openResults();
+            [this]<std::size_t... Is>(std::index_sequence<Is...>)
+            {
+                (std::get<Is>(_stages)->bind(inputOf<Is>(), outputOf<Is>(),
+                                             makeContext()),
+                 ...);
+            }
+            (std::make_index_sequence<std::tuple_size_v<stages_t>>{});
+            warmUp();
+
+            // Leftovers of a paused run are processed before new input.
+            drain<1>();
+            while (detail::Step::Finished != std::get<0>(_stages)->poll())
+            {
+                drain<1>();
+            }
+            drain<1>(); // Propagate the end of the stream.
+            coolDown();
+
+            _state = State::Idle;
+            ret = ReturnValue::Ok;
+        }
+    }
+
+    return ret;
+}
+
+template <class... Ts> ReturnValue Pipeline<Ts...>::consume(SizeHint hint)
+{
+    return hint.items <= hint.synchronousLimit ? consume(Synchronous{})
+                                               : consume();
+}
+
+template <class... Ts>
+std::chrono::nanoseconds Pipeline<Ts...>::cpuTime() const
+{
+    return std::chrono::nanoseconds(_tenant ? _tenant->cpuNs.load() : 0);
+}
+
 // Deduction guides.
+Pipeline(WorkStealing) -> Pipeline<>;
+Pipeline(Executor) -> Pipeline<>;
+Pipeline(AutoFuse) -> Pipeline<>;
+Pipeline(Tokens) -> Pipeline<>;
+Pipeline(InlineHandoff) -> Pipeline<>;
+template <class T> Pipeline(Ingress<T>) -> Pipeline<void, T>;
+template <class T>
+Pipeline(Requests<T>) -> Pipeline<void, detail::Tagged<T>>;
+
 template <class F>
-Pipeline(Pipeline<> &&, F &&fun) -> Pipeline<void, std::invoke_result_t<F>>;
+Pipeline(Pipeline<> &&, F &&fun) -> Pipeline<void, op_result_t<F>>;
 
 template <class F, class... Ts>
 Pipeline(Pipeline<Ts...> &&, F &&fun)
@@ -293,14 +1122,23 @@ Pipeline(Pipeline<Ts...> &&, F &&fun)
                 typename std::conditional_t<sizeof...(Ts), last_type<Ts...>,
                                             std::type_identity<void>>::type,
                 typename std::conditional_t<
-                    sizeof...(Ts), std::invoke_result<F, last_type_t<Ts...>>,
-                    std::invoke_result<F>>::type>;
+                    sizeof...(Ts), detail::op_result<F, last_type_t<Ts...>>,
+                    detail::op_result<F>>::type>;
 
-// Chaining operator.
+// Chaining operator. Stages of pipelines serving requests carry the ticket of
+// every request along with its data.
 template <class... Ts, class F>
 auto operator|(Pipeline<Ts...> &&pl, F &&transform)
 {
-    return Pipeline(std::move(pl), std::forward<F>(transform));
+    if constexpr ((detail::tagged<Ts> || ...))
+    {
+        return Pipeline(std::move(pl),
+                        detail::Ticketed(std::forward<F>(transform)));
+    }
+    else
+    {
+        return Pipeline(std::move(pl), std::forward<F>(transform));
+    }
 }
 
 // Abstract base class creator.
@@ -311,4 +1149,46 @@ std::unique_ptr<pipeline> make_pipeline(Fs &&...transforms)
     return std::make_unique<pipeline_t>((Pipeline{} | ... | transforms));
 }
 
+// Abstract base class creator, for pipelines in executor mode.
+template <class... Fs>
+std::unique_ptr<pipeline> make_pipeline(WorkStealing mode, Fs &&...transforms)
+{
+    using pipeline_t = decltype((Pipeline{mode} | ... | transforms));
+    return std::make_unique<pipeline_t>((Pipeline{mode} | ... | transforms));
+}
+
+// Abstract base class creator, for pipelines sharing an executor.
+template <class... Fs>
+std::unique_ptr<pipeline> make_pipeline(Executor executor, Fs &&...transforms)
+{
+    using pipeline_t = decltype((Pipeline{executor} | ... | transforms));
+    return std::make_unique<pipeline_t>(
+        (Pipeline{executor} | ... | transforms));
+}
+
+// Abstract base class creator, for self tuning pipelines.
+template <class... Fs>
+std::unique_ptr<pipeline> make_pipeline(AutoFuse mode, Fs &&...transforms)
+{
+    using pipeline_t = decltype((Pipeline{mode} | ... | transforms));
+    return std::make_unique<pipeline_t>((Pipeline{mode} | ... | transforms));
+}
+
+// Abstract base class creator, for pipelines in run-to-completion mode.
+template <class... Fs>
+std::unique_ptr<pipeline> make_pipeline(Tokens mode, Fs &&...transforms)
+{
+    using pipeline_t = decltype((Pipeline{mode} | ... | transforms));
+    return std::make_unique<pipeline_t>((Pipeline{mode} | ... | transforms));
+}
+
+// Abstract base class creator, for pipelines with opportunistic inline
+// handoff.
+template <class... Fs>
+std::unique_ptr<pipeline> make_pipeline(InlineHandoff mode, Fs &&...transforms)
+{
+    using pipeline_t = decltype((Pipeline{mode} | ... | transforms));
+    return std::make_unique<pipeline_t>((Pipeline{mode} | ... | transforms));
+}
+
 } // namespace yap
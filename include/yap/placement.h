@@ -0,0 +1,284 @@
+// © 2022 Nikolaos Athanasiou, github.com/picanumber
+#pragma once
+
+#include "runtime_utilities.h"
+#include "stage_context.h"
+
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace yap
+{
+
+/**
+ * @brief Scheduling class of a stage thread. Real time classes usually
+ * require elevated privileges.
+ */
+enum class SchedulingClass : uint8_t
+{
+    Inherit,   // Keep the class of the thread that runs the pipeline.
+    Normal,    // Time sharing, the priority is the nice value.
+    Batch,     // Time sharing for throughput, the priority is the nice value.
+    Idle,      // Runs only when nothing else is runnable.
+    Fifo,      // Real time first-in first-out, priority in [1, 99].
+    RoundRobin // Real time round robin, priority in [1, 99].
+};
+
+/**
+ * @brief Where and how the thread of a stage runs. Memory is placed by the
+ * kernel on the NUMA node of the thread that first touches it, and the
+ * storage of a buffer is allocated by the stage pushing to it, so a pinned
+ * stage allocates its output buffer on its own node.
+ */
+struct Placement
+{
+    std::vector<unsigned> cpus; // Allowed CPUs. Empty to run anywhere.
+    SchedulingClass scheduling = SchedulingClass::Inherit;
+    int priority = 0;
+
+    /**
+     * @brief Run on the CPUs of a NUMA node.
+     */
+    static Placement node(unsigned node);
+
+    /**
+     * @brief Run on the CPUs that share a cache with the given CPU, e.g. to
+     * keep adjacent stages within the same L2 or L3 domain.
+     */
+    static Placement cacheOf(unsigned cpu, unsigned level = 3);
+};
+
+namespace detail
+{
+
+// Parse a list of CPUs in the kernel format, e.g. "0-3,8,10-11".
+inline std::vector<unsigned> parseCpuList(std::string const &list)
+{
+    std::vector<unsigned> cpus;
+    std::istringstream in(list);
+    std::string range;
+    while (std::getline(in, range, ','))
+    {
+        auto dash = range.find('-');
+        try
+        {
+            unsigned first = std::stoul(range.substr(0, dash));
+            unsigned last = std::string::npos == dash
+                                ? first
+                                : std::stoul(range.substr(dash + 1));
+            for (unsigned cpu(first); cpu <= last; ++cpu)
+            {
+                cpus.push_back(cpu);
+            }
+        }
+        catch (std::exception &)
+        {
+            // Skip malformed entries, e.g. the trailing newline.
+        }
+    }
+    return cpus;
+}
+
+inline std::string readLine(std::string const &path)
+{
+    std::ifstream in(path);
+    std::string line;
+    std::getline(in, line);
+    return line;
+}
+
+/**
+ * @brief Apply a placement to the calling thread. Settings the platform does
+ * not support, or the process is not allowed to use, are skipped.
+ *
+ * @return Whether every setting was applied.
+ */
+inline bool place(Placement const &placement)
+{
+#if defined(__linux__)
+    bool ret = true;
+
+    if (!placement.cpus.empty())
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (auto cpu : placement.cpus)
+        {
+            if (cpu < CPU_SETSIZE)
+            {
+                CPU_SET(cpu, &set);
+            }
+        }
+        ret &= 0 == pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+
+    int policy = SCHED_OTHER;
+    switch (placement.scheduling)
+    {
+    case SchedulingClass::Inherit:
+        return ret;
+    case SchedulingClass::Normal:
+        policy = SCHED_OTHER;
+        break;
+    case SchedulingClass::Batch:
+        policy = SCHED_BATCH;
+        break;
+    case SchedulingClass::Idle:
+        policy = SCHED_IDLE;
+        break;
+    case SchedulingClass::Fifo:
+        policy = SCHED_FIFO;
+        break;
+    case SchedulingClass::RoundRobin:
+        policy = SCHED_RR;
+        break;
+    }
+
+    bool realTime = SCHED_FIFO == policy || SCHED_RR == policy;
+    sched_param param{};
+    param.sched_priority = realTime ? placement.priority : 0;
+    ret &= 0 == pthread_setschedparam(pthread_self(), policy, &param);
+
+    if (SCHED_OTHER == policy || SCHED_BATCH == policy)
+    {
+        // Nice values apply per thread on Linux.
+        auto tid = static_cast<id_t>(syscall(SYS_gettid));
+        ret &= 0 == setpriority(PRIO_PROCESS, tid, placement.priority);
+    }
+    return ret;
+#else
+    return placement.cpus.empty() &&
+           SchedulingClass::Inherit == placement.scheduling;
+#endif
+}
+
+template <class F>
+concept placed_op =
+    requires { typename std::remove_cvref_t<F>::placement_tag; };
+
+template <class F> Placement placementOf(F const &op)
+{
+    if constexpr (placed_op<F>)
+    {
+        return op.placement();
+    }
+    else if constexpr (wrapping_op<F>)
+    {
+        return placementOf(op.wrapped());
+    }
+    else
+    {
+        return {};
+    }
+}
+
+} // namespace detail
+
+inline Placement Placement::node(unsigned node)
+{
+    Placement ret;
+#if defined(__linux__)
+    ret.cpus = detail::parseCpuList(detail::readLine(
+        "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"));
+#endif
+    return ret;
+}
+
+inline Placement Placement::cacheOf(unsigned cpu, unsigned level)
+{
+    Placement ret;
+#if defined(__linux__)
+    auto dir = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/cache/";
+    for (int index(0);; ++index)
+    {
+        auto prefix = dir + "index" + std::to_string(index) + "/";
+        auto found = detail::readLine(prefix + "level");
+        if (found.empty())
+        {
+            break;
+        }
+        if (std::to_string(level) == found &&
+            "Instruction" != detail::readLine(prefix + "type"))
+        {
+            ret.cpus = detail::parseCpuList(
+                detail::readLine(prefix + "shared_cpu_list"));
+            break;
+        }
+    }
+#endif
+    return ret;
+}
+
+/**
+ * @brief Runs an operation as a stage with the given placement. Applies to
+ * stages running on a dedicated thread, while other modes ignore it:
+ *
+ *     auto pl = yap::Pipeline{} | gen
+ *             | yap::Placed(parse, yap::Placement::cacheOf(2))
+ *             | yap::Placed(store, yap::Placement::cacheOf(2));
+ *
+ * @tparam F Type of the wrapped operation.
+ */
+template <class F> class Placed
+{
+    F _op;
+    Placement _placement;
+
+  public:
+    using emitting_tag = void;
+    using placement_tag = void;
+
+    template <class... Args> using output_t = op_result_t<F, Args...>;
+
+    Placed(F op, Placement placement)
+        : _op(std::move(op)), _placement(std::move(placement))
+    {
+    }
+
+    Placement const &placement() const noexcept
+    {
+        return _placement;
+    }
+
+    template <class E, class... Args>
+    void feed(StageContext &ctx, E &&emit, Args &&...args)
+    {
+        detail::apply_op(_op, ctx, emit, std::forward<Args>(args)...);
+    }
+
+    void on_start()
+        requires detail::start_hook<F>
+    {
+        _op.on_start();
+    }
+
+    void on_stop()
+        requires detail::stop_hook<F>
+    {
+        _op.on_stop();
+    }
+
+    void on_barrier()
+        requires detail::barrier_hook<F>
+    {
+        _op.on_barrier();
+    }
+};
+
+template <class F> Placed(F, Placement) -> Placed<F>;
+
+} // namespace yap
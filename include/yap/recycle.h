@@ -0,0 +1,221 @@
+// © 2022 Nikolaos Athanasiou, github.com/picanumber
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <utility>
+
+namespace yap
+{
+
+namespace detail
+{
+
+/**
+ * @brief Bounded lock-free queue of recycled objects, for any number of
+ * threads on either end. Every cell carries a sequence number that tells
+ * whether it's ready to be written or read at a given position, so threads
+ * only contend on the position counters.
+ */
+template <class T> class RecyclePool
+{
+    struct Cell
+    {
+        std::atomic_size_t seq;
+        std::optional<T> value;
+    };
+
+    std::unique_ptr<Cell[]> _cells;
+    std::size_t const _mask;
+
+    alignas(64) std::atomic_size_t _readPos{0};
+    alignas(64) std::atomic_size_t _writePos{0};
+    alignas(64) std::atomic_size_t _misses{0};
+
+  public:
+    explicit RecyclePool(std::size_t capacity)
+        : _cells(std::make_unique<Cell[]>(
+              std::bit_ceil(std::max<std::size_t>(2, capacity)))),
+          _mask(std::bit_ceil(std::max<std::size_t>(2, capacity)) - 1)
+    {
+        for (std::size_t i(0); i <= _mask; ++i)
+        {
+            _cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    RecyclePool(RecyclePool const &) = delete;
+    RecyclePool &operator=(RecyclePool const &) = delete;
+
+    std::size_t capacity() const noexcept
+    {
+        return _mask + 1;
+    }
+
+    std::size_t misses() const noexcept
+    {
+        return _misses.load(std::memory_order_relaxed);
+    }
+
+    void miss() noexcept
+    {
+        _misses.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Store an object, unless the pool is full.
+    bool push(T &&obj)
+    {
+        auto pos = _writePos.load(std::memory_order_relaxed);
+        while (true)
+        {
+            auto &cell = _cells[pos & _mask];
+            auto seq = cell.seq.load(std::memory_order_acquire);
+            auto diff = static_cast<std::intptr_t>(seq) -
+                        static_cast<std::intptr_t>(pos);
+            if (0 == diff)
+            {
+                if (_writePos.compare_exchange_weak(pos, pos + 1,
+                                                    std::memory_order_relaxed))
+                {
+                    cell.value.emplace(std::move(obj));
+                    cell.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false; // Full.
+            }
+            else
+            {
+                pos = _writePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Take an object, if the pool has any.
+    std::optional<T> pop()
+    {
+        auto pos = _readPos.load(std::memory_order_relaxed);
+        while (true)
+        {
+            auto &cell = _cells[pos & _mask];
+            auto seq = cell.seq.load(std::memory_order_acquire);
+            auto diff = static_cast<std::intptr_t>(seq) -
+                        static_cast<std::intptr_t>(pos + 1);
+            if (0 == diff)
+            {
+                if (_readPos.compare_exchange_weak(pos, pos + 1,
+                                                   std::memory_order_relaxed))
+                {
+                    std::optional<T> ret(std::move(cell.value));
+                    cell.value.reset();
+                    cell.seq.store(pos + _mask + 1, std::memory_order_release);
+                    return ret;
+                }
+            }
+            else if (diff < 0)
+            {
+                return std::nullopt; // Empty.
+            }
+            else
+            {
+                pos = _readPos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+};
+
+} // namespace detail
+
+/**
+ * @brief Return channel for payload objects, so that buffers allocated by an
+ * upstream stage are reused instead of being freed downstream. Stages that
+ * consume a payload release it, and stages that produce one acquire it, which
+ * only allocates while the pool is empty:
+ *
+ *     yap::Recycler<std::vector<int>> mats(32);
+ *     auto gen = [mats] {
+ *         auto mat = mats.acquire(); // Keeps the capacity it had.
+ *         fill(mat);
+ *         return mat;
+ *     };
+ *     auto sink = [mats](std::vector<int> mat) {
+ *         use(mat);
+ *         mats.release(std::move(mat));
+ *     };
+ *
+ * The channel is bounded and lock-free. Copies of a recycler share the same
+ * pool, so each stage can capture its own. Once the pool holds as many objects
+ * as are in flight, a steady run performs no payload allocations.
+ *
+ * @tparam T Type of the recycled objects.
+ */
+template <class T> class Recycler
+{
+    std::shared_ptr<detail::RecyclePool<T>> _pool;
+
+  public:
+    /**
+     * @brief Create a pool that keeps up to capacity objects, rounded up to
+     * a power of two.
+     */
+    explicit Recycler(std::size_t capacity = 64)
+        : _pool(std::make_shared<detail::RecyclePool<T>>(capacity))
+    {
+    }
+
+    std::size_t capacity() const noexcept
+    {
+        return _pool->capacity();
+    }
+
+    /**
+     * @brief Number of acquisitions that found the pool empty and had to
+     * create an object.
+     */
+    std::size_t misses() const noexcept
+    {
+        return _pool->misses();
+    }
+
+    /**
+     * @brief Take a recycled object, or create one with make if none is left.
+     * Recycled objects are handed out as released, so their contents are
+     * stale.
+     */
+    template <class F> T acquire(F &&make) const
+    {
+        if (auto obj = _pool->pop())
+        {
+            return std::move(*obj);
+        }
+        _pool->miss();
+        return std::forward<F>(make)();
+    }
+
+    T acquire() const
+        requires std::default_initializable<T>
+    {
+        return acquire([] { return T{}; });
+    }
+
+    /**
+     * @brief Return an object for reuse.
+     *
+     * @return False if the pool was full, in which case the object is left
+     * to the caller.
+     */
+    bool release(T &&obj) const
+    {
+        return _pool->push(std::move(obj));
+    }
+};
+
+} // namespace yap
@@ -0,0 +1,204 @@
+// © 2022 Nikolaos Athanasiou, github.com/picanumber
+#pragma once
+
+#include "buffer_queue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace yap
+{
+
+namespace detail
+{
+
+/**
+ * @brief Shared state of a parallel reduction. Items are dealt round-robin to
+ * a number of lanes, each one owning a worker thread and a private partial
+ * result. Partial results are only combined when a result is requested.
+ */
+template <class IN, class T, class A, class C> class ReduceState
+{
+    struct Lane
+    {
+        BufferQueue<IN> items;
+        T partial;
+        std::mutex mtx; // Guards the partial result.
+
+        explicit Lane(T const &identity) : partial(identity)
+        {
+        }
+    };
+
+    T _identity;
+    A _accumulate;
+    C _combine;
+
+    std::vector<std::unique_ptr<Lane>> _lanes;
+    std::vector<std::thread> _workers;
+    std::size_t _nextLane{0};
+
+    std::atomic_size_t _submitted{0};
+    std::atomic_size_t _processed{0};
+
+  public:
+    ReduceState(T identity, A accumulate, C combine, std::size_t nWorkers)
+        : _identity(std::move(identity)), _accumulate(std::move(accumulate)),
+          _combine(std::move(combine))
+    {
+        nWorkers = std::max<std::size_t>(1, nWorkers);
+
+        _lanes.reserve(nWorkers);
+        _workers.reserve(nWorkers);
+        for (std::size_t i(0); i < nWorkers; ++i)
+        {
+            _lanes.emplace_back(std::make_unique<Lane>(_identity));
+            _workers.emplace_back(&ReduceState::work, this,
+                                  std::ref(*_lanes.back()));
+        }
+    }
+
+    ReduceState(ReduceState const &) = delete;
+    ReduceState &operator=(ReduceState const &) = delete;
+
+    ~ReduceState()
+    {
+        for (auto &lane : _lanes)
+        {
+            lane->items.set(BufferBehavior::Closed);
+        }
+        for (auto &worker : _workers)
+        {
+            worker.join();
+        }
+    }
+
+    // Expected to be called from a single thread, i.e. the sink stage.
+    void push(IN item)
+    {
+        auto &lane = *_lanes[_nextLane];
+        _nextLane = (_nextLane + 1) % _lanes.size();
+
+        _submitted.fetch_add(1, std::memory_order_relaxed);
+        lane.items.push(std::move(item));
+    }
+
+    // Wait for items submitted so far to be accumulated and merge the lanes.
+    T result()
+    {
+        auto const target = _submitted.load(std::memory_order_relaxed);
+        for (auto done = _processed.load(); done < target;
+             done = _processed.load())
+        {
+            _processed.wait(done);
+        }
+
+        T ret{_identity};
+        for (auto &lane : _lanes)
+        {
+            std::lock_guard lk(lane->mtx);
+            ret = std::invoke(_combine, std::move(ret), lane->partial);
+        }
+
+        return ret;
+    }
+
+  private:
+    void work(Lane &lane)
+    {
+        try
+        {
+            while (true)
+            {
+                auto item = lane.items.pop();
+                try
+                {
+                    std::lock_guard lk(lane.mtx);
+                    lane.partial = std::invoke(
+                        _accumulate, std::move(lane.partial), std::move(item));
+                }
+                catch (...)
+                {
+                    // Accumulation threw. The item is dropped.
+                }
+
+                _processed.fetch_add(1);
+                _processed.notify_all();
+            }
+        }
+        catch (detail::ClosedError &)
+        {
+            // The reduction is being destroyed.
+        }
+    }
+};
+
+} // namespace detail
+
+/**
+ * @brief A sink stage that accumulates its input in parallel.
+ *
+ * @details Every item reaching the sink is handed to one of N accumulators,
+ * each running in its own thread on private state. Partial results are merged
+ * with the combine operation when the result is requested. Copies of a
+ * reduction share their state, so a handle kept by the user can query the
+ * result of the copy placed in the pipeline.
+ *
+ * @tparam IN Type of the items reaching the sink.
+ * @tparam T Type of the reduction result.
+ * @tparam A Accumulation operation, invocable as T(T, IN).
+ * @tparam C Combination operation, invocable as T(T, T).
+ */
+template <class IN, class T, class A, class C> class Reduction
+{
+    std::shared_ptr<detail::ReduceState<IN, T, A, C>> _state;
+
+  public:
+    Reduction(T identity, A accumulate, C combine, std::size_t nWorkers)
+        : _state(std::make_shared<detail::ReduceState<IN, T, A, C>>(
+              std::move(identity), std::move(accumulate), std::move(combine),
+              nWorkers))
+    {
+    }
+
+    void operator()(IN item)
+    {
+        _state->push(std::move(item));
+    }
+
+    /**
+     * @brief Merge the partial results of all accumulators. Blocks until every
+     * item that has reached the sink so far is accumulated, so calling it
+     * after "consume" yields the reduction of the whole input.
+     */
+    T result() const
+    {
+        return _state->result();
+    }
+};
+
+/**
+ * @brief Create a parallel reduction sink.
+ *
+ * @tparam IN Type of the items reaching the sink. Has to be specified.
+ * @param identity Initial value of every partial result.
+ * @param accumulate Operation folding an item into a partial result.
+ * @param combine Operation merging two partial results.
+ * @param nWorkers Number of accumulators running in parallel.
+ */
+template <class IN, class T, class A, class C>
+auto Reduce(T identity, A accumulate, C combine,
+            std::size_t nWorkers = std::thread::hardware_concurrency())
+{
+    return Reduction<IN, T, A, C>(std::move(identity), std::move(accumulate),
+                                  std::move(combine), nWorkers);
+}
+
+} // namespace yap
@@ -0,0 +1,371 @@
+// © 2022 Nikolaos Athanasiou, github.com/picanumber
+#pragma once
+
+#include "buffer_queue.h"
+#include "compile_time_utilities.h"
+#include "runtime_utilities.h"
+#include "stage_context.h"
+
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <future>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+namespace yap
+{
+
+/**
+ * @brief Selects a pipeline that serves requests: every item is submitted on
+ * its own and the submitter gets the result of that item back. Like a
+ * pipeline with pushed input, it has no generator, and its first buffer holds
+ * up to capacity requests.
+ *
+ * @tparam T Type of the submitted requests.
+ */
+template <class T> struct Requests
+{
+    std::size_t capacity = 1024; // Zero for an unbounded buffer.
+};
+
+namespace detail
+{
+
+/**
+ * @brief Completion state of a request, shared by its response and the
+ * ticket carried along with its data.
+ */
+class CompletionBase
+{
+  protected:
+    enum : int
+    {
+        Pending,
+        Ready,
+        Failed
+    };
+
+  private:
+    std::atomic_int _state{Pending};
+    std::exception_ptr _error;
+
+    // Coroutine awaiting the response, or this once the request completed.
+    std::atomic<void *> _waiter{nullptr};
+
+  public:
+    virtual ~CompletionBase() = default;
+
+    bool ready() const noexcept
+    {
+        return Pending != _state.load(std::memory_order_acquire);
+    }
+
+    void wait() const noexcept
+    {
+        _state.wait(Pending, std::memory_order_acquire);
+    }
+
+    // Resume h on completion. Returns false if the request completed already.
+    bool suspend(std::coroutine_handle<> h)
+    {
+        void *expected = nullptr;
+        return _waiter.compare_exchange_strong(expected, h.address(),
+                                               std::memory_order_acq_rel);
+    }
+
+    void fail(std::exception_ptr error)
+    {
+        _error = std::move(error);
+        finish(Failed);
+    }
+
+  protected:
+    void finish(int state)
+    {
+        _state.store(state, std::memory_order_release);
+        _state.notify_all();
+        if (void *waiter = _waiter.exchange(this, std::memory_order_acq_rel))
+        {
+            std::coroutine_handle<>::from_address(waiter).resume();
+        }
+    }
+
+    // Expects the request to be complete.
+    void rethrow() const
+    {
+        if (Failed == _state.load(std::memory_order_acquire))
+        {
+            std::rethrow_exception(_error);
+        }
+    }
+};
+
+template <class R> class Completion final : public CompletionBase
+{
+    std::optional<R> _value;
+
+  public:
+    template <class U> void set(U &&value)
+    {
+        _value.emplace(std::forward<U>(value));
+        finish(Ready);
+    }
+
+    R take()
+    {
+        wait();
+        rethrow();
+        return std::move(*_value);
+    }
+};
+
+/**
+ * @brief Completion handle of a request, carried along with its data. A
+ * ticket destroyed before completing, e.g. because a filter dropped its item,
+ * fails the request with a broken promise.
+ */
+class Ticket
+{
+    std::shared_ptr<CompletionBase> _completion;
+
+  public:
+    Ticket() = default;
+
+    explicit Ticket(std::shared_ptr<CompletionBase> completion)
+        : _completion(std::move(completion))
+    {
+    }
+
+    Ticket(Ticket &&) noexcept = default;
+
+    Ticket &operator=(Ticket &&other) noexcept
+    {
+        if (this != &other)
+        {
+            drop();
+            _completion = std::move(other._completion);
+        }
+        return *this;
+    }
+
+    ~Ticket()
+    {
+        drop();
+    }
+
+    template <class R> void complete(R &&value)
+    {
+        if (auto completion = std::exchange(_completion, nullptr))
+        {
+            static_cast<Completion<std::remove_cvref_t<R>> &>(*completion)
+                .set(std::forward<R>(value));
+        }
+    }
+
+    void fail(std::exception_ptr error)
+    {
+        if (auto completion = std::exchange(_completion, nullptr))
+        {
+            completion->fail(std::move(error));
+        }
+    }
+
+  private:
+    void drop()
+    {
+        if (_completion)
+        {
+            fail(std::make_exception_ptr(
+                std::future_error(std::future_errc::broken_promise)));
+        }
+    }
+};
+
+/**
+ * @brief Data of a request as it flows between the stages of a pipeline that
+ * serves requests, along with the ticket of the request.
+ */
+template <class T> struct Tagged
+{
+    static_assert(!std::is_void_v<T>,
+                  "Pipelines serving requests have no sink, since the "
+                  "outputs of the last stage are the responses");
+
+    using value_type = T;
+
+    Ticket ticket;
+    T value;
+};
+
+template <class T>
+concept tagged = instantiation_of<std::remove_cvref_t<T>, Tagged>;
+
+/**
+ * @brief Applies an operation to the data of a request and tags its outputs
+ * with the ticket of the request. The first output carries the ticket, and
+ * an exception thrown by the operation fails the request.
+ *
+ * @tparam F Type of the wrapped operation.
+ */
+template <class F> class Ticketed
+{
+    F _op;
+
+  public:
+    using emitting_tag = void;
+
+    template <class... Args>
+    using output_t = Tagged<
+        op_result_t<F, typename std::remove_cvref_t<Args>::value_type...>>;
+
+    explicit Ticketed(F op) : _op(std::move(op))
+    {
+    }
+
+    F const &wrapped() const noexcept
+    {
+        return _op;
+    }
+
+    template <class E, tagged In>
+    void feed(StageContext &ctx, E &&emit, In &&request)
+    {
+        using out_t =
+            op_result_t<F, typename std::remove_cvref_t<In>::value_type>;
+
+        Ticket ticket = std::move(request.ticket);
+        auto tag = [&emit, &ticket](out_t &&out) {
+            emit(Tagged<out_t>{std::move(ticket), std::move(out)});
+        };
+
+        try
+        {
+            apply_op(_op, ctx, tag, std::move(request.value));
+        }
+        catch (GeneratorExit &)
+        {
+            throw;
+        }
+        catch (...)
+        {
+            ticket.fail(std::current_exception());
+            throw;
+        }
+    }
+
+    void on_start()
+        requires start_hook<F>
+    {
+        _op.on_start();
+    }
+
+    void on_stop()
+        requires stop_hook<F>
+    {
+        _op.on_stop();
+    }
+
+    void on_barrier()
+        requires barrier_hook<F>
+    {
+        _op.on_barrier();
+    }
+};
+
+template <class F> Ticketed(F) -> Ticketed<F>;
+
+/**
+ * @brief Completes requests with the outputs of the last stage, on the
+ * thread that pushes them.
+ */
+template <class R> class Completer final : public PushListener
+{
+    std::shared_ptr<BufferQueue<std::future<Tagged<R>>>> _responses;
+
+  public:
+    explicit Completer(
+        std::shared_ptr<BufferQueue<std::future<Tagged<R>>>> responses)
+        : _responses(std::move(responses))
+    {
+    }
+
+    void onPush() override
+    {
+        while (auto response = _responses->tryPop())
+        {
+            try
+            {
+                auto done = response->get();
+                done.ticket.complete(std::move(done.value));
+            }
+            catch (Barrier &barrier)
+            {
+                barrier.pass();
+            }
+            catch (GeneratorExit &)
+            {
+                // End of the stream, which no request waits for.
+            }
+        }
+    }
+};
+
+} // namespace detail
+
+/**
+ * @brief Result of a submitted request. It can be waited on, or awaited by a
+ * coroutine, which is then resumed on the thread that completes the request.
+ *
+ * @tparam R Type produced by the last stage of the pipeline.
+ */
+template <class R> class Response
+{
+    std::shared_ptr<detail::Completion<R>> _completion;
+
+  public:
+    explicit Response(std::shared_ptr<detail::Completion<R>> completion)
+        : _completion(std::move(completion))
+    {
+    }
+
+    bool ready() const noexcept
+    {
+        return _completion->ready();
+    }
+
+    void wait() const noexcept
+    {
+        _completion->wait();
+    }
+
+    /**
+     * @brief Wait for the result and take it. Rethrows the exception that
+     * failed the request, if any, i.e. a std::future_error if its item was
+     * dropped.
+     */
+    R get()
+    {
+        return _completion->take();
+    }
+
+    bool await_ready() const noexcept
+    {
+        return ready();
+    }
+
+    bool await_suspend(std::coroutine_handle<> h)
+    {
+        return _completion->suspend(h);
+    }
+
+    R await_resume()
+    {
+        return get();
+    }
+};
+
+} // namespace yap
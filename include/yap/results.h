@@ -0,0 +1,148 @@
+// © 2022 Nikolaos Athanasiou, github.com/picanumber
+#pragma once
+
+#include "buffer_queue.h"
+#include "runtime_utilities.h"
+
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <utility>
+
+namespace yap
+{
+
+/**
+ * @brief Input range over the outputs of a pipeline without a sink. Items are
+ * pulled straight out of the buffer the last stage pushes to, and the range
+ * ends with the stream:
+ *
+ *     auto pl = yap::Pipeline{} | gen | transform;
+ *     for (auto &&res : pl.results())
+ *     {
+ *         use(std::move(res));
+ *     }
+ *
+ * Reaching the end leaves the pipeline idle, as consume would. Stopping the
+ * pipeline ends the range early, while pausing it makes the range wait until
+ * the pipeline runs again. The pipeline must outlive the range.
+ *
+ * @tparam T Type of the items produced by the last stage.
+ */
+template <class T> class Results
+{
+    std::shared_ptr<BufferQueue<std::future<T>>> _buffer;
+    std::function<void()> _finish;
+    std::optional<T> _current;
+
+  public:
+    class iterator
+    {
+        Results *_range{nullptr};
+
+      public:
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+
+        iterator() = default;
+
+        explicit iterator(Results *range) : _range(range)
+        {
+        }
+
+        T &operator*() const
+        {
+            return *_range->_current;
+        }
+
+        T *operator->() const
+        {
+            return &*_range->_current;
+        }
+
+        iterator &operator++()
+        {
+            _range->next();
+            return *this;
+        }
+
+        void operator++(int)
+        {
+            ++*this;
+        }
+
+        bool ended() const
+        {
+            return !_range || !_range->_current;
+        }
+
+        friend bool operator==(iterator const &it, std::default_sentinel_t)
+        {
+            return it.ended();
+        }
+    };
+
+    /**
+     * @param buffer Receives the outputs of the last stage, followed by a
+     * GeneratorExit when the stream ends.
+     * @param finish Invoked once the end of the stream is pulled.
+     */
+    Results(std::shared_ptr<BufferQueue<std::future<T>>> buffer,
+            std::function<void()> finish)
+        : _buffer(std::move(buffer)), _finish(std::move(finish))
+    {
+    }
+
+    Results(Results const &) = delete;
+    Results &operator=(Results const &) = delete;
+    Results(Results &&) = default;
+    Results &operator=(Results &&) = default;
+
+    // Pulls the first item, so only call it once.
+    iterator begin()
+    {
+        next();
+        return iterator(this);
+    }
+
+    std::default_sentinel_t end() const noexcept
+    {
+        return std::default_sentinel;
+    }
+
+  private:
+    // Block until the next item arrives, or the stream ends. Flush barriers
+    // complete as they're pulled.
+    void next()
+    {
+        _current.reset();
+        while (_buffer && !_current)
+        {
+            try
+            {
+                _current.emplace(_buffer->pop().get());
+            }
+            catch (detail::Barrier &barrier)
+            {
+                barrier.pass();
+            }
+            catch (GeneratorExit &)
+            {
+                _buffer.reset();
+                if (auto finish = std::exchange(_finish, nullptr))
+                {
+                    finish();
+                }
+            }
+            catch (detail::ClosedError &)
+            {
+                _buffer.reset();
+            }
+        }
+    }
+};
+
+} // namespace yap
@@ -1,8 +1,16 @@
 // © 2022 Nikolaos Athanasiou, github.com/picanumber
 #pragma once
 
+#include "compile_time_utilities.h"
+#include "coroutine.h"
+#include "stage_context.h"
+#include "topology.h"
+
 #include <future>
+#include <memory>
 #include <stdexcept>
+#include <stop_token>
+#include <type_traits>
 
 namespace yap
 {
@@ -87,16 +95,274 @@ template <class T, class E> std::future<T> make_exceptional_future(E ex)
 namespace detail
 {
 
+/**
+ * @brief Marker that flows through a pipeline behind the items buffered
+ * before it, in an exceptional future like the end of the stream. Stages
+ * invoke the barrier hook of their operation as it passes, and the sink
+ * completes it. A barrier dropped on the way, e.g. by stopping the pipeline,
+ * breaks its promise.
+ */
+class Barrier
+{
+    std::shared_ptr<std::promise<void>> _done;
+
+  public:
+    Barrier() : _done(std::make_shared<std::promise<void>>())
+    {
+    }
+
+    std::future<void> completion() const
+    {
+        return _done->get_future();
+    }
+
+    void pass() const
+    {
+        _done->set_value();
+    }
+};
+
+// Invoke a stage operation, passing the stage context or its stop token if
+// the operation accepts one as its last argument.
+template <class F, class... Args>
+decltype(auto) invoke_op(F &f, StageContext &ctx, Args &&...args)
+{
+    if constexpr (std::is_invocable_v<F &, Args..., StageContext &>)
+    {
+        return f(std::forward<Args>(args)..., ctx);
+    }
+    else if constexpr (std::is_invocable_v<F &, Args..., std::stop_token>)
+    {
+        return f(std::forward<Args>(args)..., ctx.stopToken());
+    }
+    else
+    {
+        return f(std::forward<Args>(args)...);
+    }
+}
+
+/**
+ * @brief Operations that produce any number of outputs per input by passing
+ * them to a callback, e.g. fused stages. Such operations expose:
+ *
+ * - feed(ctx, emit, args...) to process an input,
+ * - output_t<Args...> as the type of the produced outputs.
+ */
+template <class F>
+concept emitting_op =
+    requires { typename std::remove_cvref_t<F>::emitting_tag; };
+
+/**
+ * @brief Operations that wrap another one and expose it as wrapped(), so that
+ * a stage honors the placement and the arena of the wrapped operation.
+ */
+template <class F>
+concept wrapping_op = requires(F const &f) { f.wrapped(); };
+
+template <class F, class... Args>
+using invoke_op_t = decltype(invoke_op(std::declval<F &>(),
+                                       std::declval<StageContext &>(),
+                                       std::declval<Args>()...));
+
+/**
+ * @brief Operations implemented as coroutines, i.e. returning a Task. Their
+ * output is the value returned from the coroutine.
+ */
+template <class F, class... Args>
+concept coroutine_op =
+    !emitting_op<F> && instantiation_of<invoke_op_t<F, Args...>, Task>;
+
+template <class T> struct task_value
+{
+    using type = T;
+};
+
+template <class T> struct task_value<Task<T>>
+{
+    using type = T;
+};
+
+template <class F, class... Args> struct op_result
+{
+    using type = typename task_value<invoke_op_t<F, Args...>>::type;
+};
+
+template <emitting_op F, class... Args> struct op_result<F, Args...>
+{
+    using type =
+        typename std::remove_cvref_t<F>::template output_t<Args...>;
+};
+
+template <class F, class... Args>
+using op_result_t = typename op_result<F, Args...>::type;
+
+/**
+ * @brief Non owning reference to the callback receiving the outputs of an
+ * operation.
+ */
+template <class T> class Emitter
+{
+    void *_target;
+    void (*_call)(void *, T &&);
+
+  public:
+    template <class F>
+        requires(!std::is_same_v<std::remove_cvref_t<F>, Emitter>)
+    explicit Emitter(F &f)
+        : _target(&f), _call([](void *target, T &&val) {
+              (*static_cast<F *>(target))(std::move(val));
+          })
+    {
+    }
+
+    void operator()(T &&val) const
+    {
+        _call(_target, std::move(val));
+    }
+};
+
+// Sinks produce no output.
+template <> class Emitter<void>
+{
+};
+
+// Pass the result of an operation to emit, unless it's an empty filter.
+template <class T, class E> void emit_result(T &&result, E &emit)
+{
+    if constexpr (instantiation_of<std::remove_cvref_t<T>, Filtered>)
+    {
+        if (!result.data)
+        {
+            return;
+        }
+    }
+    emit(std::forward<T>(result));
+}
+
+/**
+ * @brief Apply an operation to its input(s) with the semantics of a pipeline
+ * stage and pass the produced outputs to emit:
+ *
+ * - A coroutine is awaited and its result is treated as the result of any
+ *   other operation.
+ * - A hatching operation is invoked again with empty input, as long as it
+ *   produces outputs convertible to true.
+ * - A filtering operation outputs nothing when its result is empty.
+ * - Any other operation produces exactly one output.
+ *
+ * Exceptions, e.g. GeneratorExit, are propagated to the caller.
+ */
+template <class F, class E, class... Args>
+void apply_op(F &f, StageContext &ctx, E &&emit, Args &&...args)
+{
+    using out_t = op_result_t<F, Args...>;
+
+    if constexpr (emitting_op<F>)
+    {
+        f.feed(ctx, emit, std::forward<Args>(args)...);
+    }
+    else if constexpr (coroutine_op<F, Args...>)
+    {
+        auto task = invoke_op(f, ctx, std::forward<Args>(args)...);
+        if constexpr (std::is_void_v<out_t>)
+        {
+            wait(task);
+        }
+        else
+        {
+            emit_result(wait(task), emit);
+        }
+    }
+    else if constexpr ((instantiation_of<std::remove_cvref_t<Args>,
+                                         Hatchable> ||
+                        ...))
+    {
+        auto result = invoke_op(f, ctx, std::forward<Args>(args)...);
+        while (result)
+        {
+            emit(std::move(result));
+            result = invoke_op(f, ctx, std::remove_cvref_t<Args>{}...);
+        }
+    }
+    else if constexpr (std::is_void_v<out_t>)
+    {
+        invoke_op(f, ctx, std::forward<Args>(args)...);
+    }
+    else if constexpr (instantiation_of<out_t, Filtered>)
+    {
+        if (auto result = invoke_op(f, ctx, std::forward<Args>(args)...);
+            result.data)
+        {
+            emit(std::move(result));
+        }
+    }
+    else
+    {
+        emit(invoke_op(f, ctx, std::forward<Args>(args)...));
+    }
+}
+
+/**
+ * @brief Operations with hooks that a stage invokes before processing its
+ * first item and after processing its last one, e.g. to allocate scratch
+ * buffers or build thread local tables off the critical path.
+ */
+template <class F>
+concept start_hook = requires(F &f) { f.on_start(); };
+
+template <class F>
+concept stop_hook = requires(F &f) { f.on_stop(); };
+
+template <class F> void startHook(F &f)
+{
+    if constexpr (start_hook<F>)
+    {
+        f.on_start();
+    }
+}
+
+template <class F> void stopHook(F &f)
+{
+    if constexpr (stop_hook<F>)
+    {
+        f.on_stop();
+    }
+}
+
+/**
+ * @brief Operations with a hook that a stage invokes when a flush barrier
+ * passes, i.e. after every item that preceded the barrier, e.g. to take a
+ * consistent snapshot of their state.
+ */
+template <class F>
+concept barrier_hook = requires(F &f) { f.on_barrier(); };
+
+template <class F> void barrierHook(F &f)
+{
+    if constexpr (barrier_hook<F>)
+    {
+        f.on_barrier();
+    }
+}
+
 template <class IN, class OUT> struct CallConcept
 {
     virtual ~CallConcept() = default;
-    virtual OUT call(IN) = 0;
+    virtual void call(IN, StageContext &, Emitter<OUT>) = 0;
+    virtual Task<OUT> spawn(IN, StageContext &) = 0;
+    virtual void onStart() = 0;
+    virtual void onStop() = 0;
+    virtual void onBarrier() = 0;
 };
 
 template <class OUT> struct CallConcept<void, OUT>
 {
     virtual ~CallConcept() = default;
-    virtual OUT call() = 0;
+    virtual void call(StageContext &, Emitter<OUT>) = 0;
+    virtual Task<OUT> spawn(StageContext &) = 0;
+    virtual void onStart() = 0;
+    virtual void onStop() = 0;
+    virtual void onBarrier() = 0;
 };
 
 template <class F, class IN, class OUT> struct CallModel : CallConcept<IN, OUT>
@@ -107,9 +373,36 @@ template <class F, class IN, class OUT> struct CallModel : CallConcept<IN, OUT>
     {
     }
 
-    OUT call(IN arg) override
+    void call(IN arg, StageContext &ctx, Emitter<OUT> emit) override
+    {
+        apply_op(f, ctx, emit, std::move(arg));
+    }
+
+    Task<OUT> spawn(IN arg, StageContext &ctx) override
+    {
+        if constexpr (coroutine_op<F, IN>)
+        {
+            return invoke_op(f, ctx, std::move(arg));
+        }
+        else
+        {
+            throw std::logic_error("Not a coroutine operation");
+        }
+    }
+
+    void onStart() override
+    {
+        startHook(f);
+    }
+
+    void onStop() override
     {
-        return f(std::move(arg));
+        stopHook(f);
+    }
+
+    void onBarrier() override
+    {
+        barrierHook(f);
     }
 };
 
@@ -122,17 +415,52 @@ struct CallModel<F, void, OUT> : CallConcept<void, OUT>
     {
     }
 
-    OUT call() override
+    void call(StageContext &ctx, Emitter<OUT> emit) override
+    {
+        apply_op(f, ctx, emit);
+    }
+
+    Task<OUT> spawn(StageContext &ctx) override
+    {
+        if constexpr (coroutine_op<F>)
+        {
+            return invoke_op(f, ctx);
+        }
+        else
+        {
+            throw std::logic_error("Not a coroutine operation");
+        }
+    }
+
+    void onStart() override
+    {
+        startHook(f);
+    }
+
+    void onStop() override
+    {
+        stopHook(f);
+    }
+
+    void onBarrier() override
     {
-        return f();
+        barrierHook(f);
     }
 };
 
 } // namespace detail
 
+/**
+ * @brief Type produced by a stage operation for the given arguments, whether
+ * or not the operation accepts a stage context.
+ */
+template <class F, class... Args>
+using op_result_t = detail::op_result_t<F, Args...>;
+
 /**
  * @brief Alternative to std::function, to allow non copyable callables to be
- * used directly in a stage.
+ * used directly in a stage. Invoking a callable passes every output produced
+ * by the stage operation to an emitter.
  *
  * @tparam IN Input type.
  * @tparam OUT Output type.
@@ -151,15 +479,52 @@ template <class IN, class OUT> class Callable
     }
 
     template <class J>
-    std::enable_if_t<not std::is_void_v<J>, OUT> operator()(J arg)
+    std::enable_if_t<not std::is_void_v<J>> operator()(
+        J arg, StageContext &ctx, detail::Emitter<OUT> emit)
+    {
+        _impl->call(std::move(arg), ctx, emit);
+    }
+
+    template <class J = void>
+    std::enable_if_t<std::is_void_v<J>> operator()(StageContext &ctx,
+                                                   detail::Emitter<OUT> emit)
+    {
+        _impl->call(ctx, emit);
+    }
+
+    /**
+     * @brief Create the coroutine of a coroutine operation without running
+     * it, so that the caller drives it.
+     */
+    template <class J>
+    std::enable_if_t<not std::is_void_v<J>, Task<OUT>> spawn(J arg,
+                                                             StageContext &ctx)
     {
-        return _impl->call(std::move(arg));
+        return _impl->spawn(std::move(arg), ctx);
     }
 
     template <class J = void>
-    std::enable_if_t<std::is_void_v<J>, OUT> operator()()
+    std::enable_if_t<std::is_void_v<J>, Task<OUT>> spawn(StageContext &ctx)
+    {
+        return _impl->spawn(ctx);
+    }
+
+    // Invoke the start hook of the operation, if it has one.
+    void onStart()
+    {
+        _impl->onStart();
+    }
+
+    // Invoke the stop hook of the operation, if it has one.
+    void onStop()
+    {
+        _impl->onStop();
+    }
+
+    // Invoke the barrier hook of the operation, if it has one.
+    void onBarrier()
     {
-        return _impl->call();
+        _impl->onBarrier();
     }
 };
 
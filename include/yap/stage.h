@@ -1,36 +1,97 @@
 // © 2022 Nikolaos Athanasiou, github.com/picanumber
 #pragma once
 
+#include "arena.h"
+#include "auto_fuse.h"
 #include "buffer_queue.h"
 #include "compile_time_utilities.h"
+#include "coroutine.h"
+#include "executor.h"
+#include "placement.h"
 #include "runtime_utilities.h"
+#include "stage_context.h"
+#include "tokens.h"
 #include "topology.h"
 
+#include <algorithm>
 #include <atomic>
+#include <condition_variable>
+#include <cstdint>
 #include <functional>
 #include <future>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <stdexcept>
+#include <stop_token>
 #include <thread>
 #include <type_traits>
+#include <vector>
 
 namespace yap
 {
 
+/**
+ * @brief Selects opportunistic inline handoff: a stage processes its outputs
+ * through the downstream stage on its own thread, instead of queuing them,
+ * while the downstream stage is idle. Under load items are queued as usual.
+ */
+struct InlineHandoff
+{
+};
+
 namespace detail
 {
 
-// Process a transformation stage. Returns whether to keep processing.
-template <class IN, class OUT>
-bool process(Callable<IN, OUT> &op,
-             std::shared_ptr<BufferQueue<std::future<IN>>> &input,
-             std::shared_ptr<BufferQueue<std::future<OUT>>> &output)
+// A flush barrier reached a stage. Invoke the barrier hook of the operation
+// and pass the barrier downstream, or complete it at the sink. Returns false
+// if the output buffer is closed.
+template <class IN, class OUT, class P>
+bool pass(Callable<IN, OUT> &op, Barrier const &barrier, P &&push)
+{
+    try
+    {
+        op.onBarrier();
+    }
+    catch (...)
+    {
+        // A failed hook doesn't hold the barrier back.
+    }
+
+    if constexpr (std::is_void_v<OUT>)
+    {
+        barrier.pass();
+        return true;
+    }
+    else
+    {
+        try
+        {
+            push(make_exceptional_future<OUT>(barrier));
+            return true;
+        }
+        catch (ClosedError &)
+        {
+            return false;
+        }
+    }
+}
+
+// Process a transformation stage. Returns whether to keep processing. Outputs
+// are passed to push, and errors on the output side, i.e. a closed buffer, are
+// handled here while the caller is responsible for acquiring the input.
+// Filtering and hatching operations output any number of items per input.
+template <class IN, class OUT, class P>
+bool process(Callable<IN, OUT> &op, StageContext &ctx,
+             std::future<IN> input, P &&push)
 {
     try
     {
         // expect not null input/output
-        output->push(make_ready_future<OUT>(op(input->pop().get())));
+        auto emit = [&push](OUT &&result) {
+            push(make_ready_future<OUT>(std::move(result)));
+        };
+        op(input.get(), ctx, Emitter<OUT>(emit));
         return true;
     }
     catch (detail::ClosedError &e)
@@ -39,9 +100,13 @@ bool process(Callable<IN, OUT> &op,
     }
     catch (GeneratorExit &e)
     {
-        output->push(make_exceptional_future<OUT>(e));
+        push(make_exceptional_future<OUT>(e));
         return false;
     }
+    catch (Barrier &barrier)
+    {
+        return pass(op, barrier, push);
+    }
     catch (...)
     {
         // Op threw an exception. No point in propagating the data.
@@ -49,18 +114,23 @@ bool process(Callable<IN, OUT> &op,
     }
 }
 
-// Process a filtering transformation stage. Returns whether to keep processing.
-template <class IN, class OUT>
-    requires(instantiation_of<OUT, Filtered>) bool
-process(Callable<IN, OUT> &op,
-        std::shared_ptr<BufferQueue<std::future<IN>>> &input,
-        std::shared_ptr<BufferQueue<std::future<OUT>>> &output)
+// Process a generator stage.
+template <class OUT, class P>
+bool process(Callable<void, OUT> &op, StageContext &ctx, P &&push)
 {
     try
     {
-        if (auto result = op(input->pop().get()); result.data)
+        // expect null input. A fused generator may also be the sink.
+        if constexpr (std::is_void_v<OUT>)
         {
-            output->push(make_ready_future<OUT>(std::move(result)));
+            op(ctx, Emitter<void>{});
+        }
+        else
+        {
+            auto emit = [&push](OUT &&result) {
+                push(make_ready_future<OUT>(std::move(result)));
+            };
+            op(ctx, Emitter<OUT>(emit));
         }
         return true;
     }
@@ -70,7 +140,10 @@ process(Callable<IN, OUT> &op,
     }
     catch (GeneratorExit &e)
     {
-        output->push(make_exceptional_future<OUT>(e));
+        if constexpr (!std::is_void_v<OUT>)
+        {
+            push(make_exceptional_future<OUT>(e));
+        }
         return false;
     }
     catch (...)
@@ -80,21 +153,15 @@ process(Callable<IN, OUT> &op,
     }
 }
 
-// Process a hatching transformation stage. Returns whether to keep processing.
-template <class IN, class OUT>
-    requires(instantiation_of<IN, Hatchable>) bool
-process(Callable<IN, OUT> &op,
-        std::shared_ptr<BufferQueue<std::future<IN>>> &input,
-        std::shared_ptr<BufferQueue<std::future<OUT>>> &output)
+// Process a sink stage.
+template <class IN, class P>
+bool process(Callable<IN, void> &op, StageContext &ctx,
+             std::future<IN> input, P &&push)
 {
     try
     {
-        auto result = op(input->pop().get());
-        while (result)
-        {
-            output->push(make_ready_future<OUT>(std::move(result)));
-            result = op(IN{});
-        }
+        // expect null output, non null input.
+        op(input.get(), ctx, Emitter<void>{});
         return true;
     }
     catch (detail::ClosedError &e)
@@ -103,9 +170,12 @@ process(Callable<IN, OUT> &op,
     }
     catch (GeneratorExit &e)
     {
-        output->push(make_exceptional_future<OUT>(e));
         return false;
     }
+    catch (Barrier &barrier)
+    {
+        return pass(op, barrier, push);
+    }
     catch (...)
     {
         // Op threw an exception. No point in propagating the data.
@@ -113,45 +183,54 @@ process(Callable<IN, OUT> &op,
     }
 }
 
-// Process a generator stage.
-template <class OUT>
-bool process(Callable<void, OUT> &op,
-             std::shared_ptr<BufferQueue<std::future<void>>> & /*input*/,
-             std::shared_ptr<BufferQueue<std::future<OUT>>> &output)
+// Create the coroutine of a coroutine stage, for an input or as a generator,
+// and pass it to park, which runs it without blocking. Returns whether to keep
+// processing, i.e. false if the input marks the end of the stream.
+template <class IN, class OUT, class P, class K, class... In>
+bool launch(Callable<IN, OUT> &op, StageContext &ctx, P &&push, K &&park,
+            In... input)
 {
     try
     {
-        // expect null input, non null output.
-        output->push(make_ready_future<OUT>(op()));
+        park(op.spawn(input.get()..., ctx));
         return true;
     }
-    catch (detail::ClosedError &e)
+    catch (GeneratorExit &e)
     {
+        if constexpr (!std::is_void_v<OUT>)
+        {
+            push(make_exceptional_future<OUT>(e));
+        }
         return false;
     }
-    catch (GeneratorExit &e)
+    catch (Barrier &barrier)
     {
-        output->push(make_exceptional_future<OUT>(e));
-        return false;
+        return pass(op, barrier, push);
     }
     catch (...)
     {
-        // Op threw an exception. No point in propagating the data.
+        // Creating the coroutine failed. No point in propagating the data.
         return true;
     }
 }
 
-// Process a sink stage.
-template <class IN>
-bool process(Callable<IN, void> &op,
-             std::shared_ptr<BufferQueue<std::future<IN>>> &input,
-             std::shared_ptr<BufferQueue<std::future<void>>> &
-             /*output*/)
+// Pass the result of a finished coroutine to push, with the semantics of
+// process.
+template <class OUT, class P> bool finish(Task<OUT> &task, P &&push)
 {
     try
     {
-        // expect null output, non null input.
-        op(input->pop().get());
+        if constexpr (std::is_void_v<OUT>)
+        {
+            task.get();
+        }
+        else
+        {
+            auto emit = [&push](OUT &&result) {
+                push(make_ready_future<OUT>(std::move(result)));
+            };
+            emit_result(task.get(), emit);
+        }
         return true;
     }
     catch (detail::ClosedError &e)
@@ -160,6 +239,10 @@ bool process(Callable<IN, void> &op,
     }
     catch (GeneratorExit &e)
     {
+        if constexpr (!std::is_void_v<OUT>)
+        {
+            push(make_exceptional_future<OUT>(e));
+        }
         return false;
     }
     catch (...)
@@ -169,52 +252,278 @@ bool process(Callable<IN, void> &op,
     }
 }
 
+template <class F, class IN> constexpr bool coroutine_stage()
+{
+    if constexpr (std::is_void_v<IN>)
+    {
+        return coroutine_op<F>;
+    }
+    else
+    {
+        return coroutine_op<F, IN>;
+    }
+}
+
+// Time the current thread idled waiting for its last input, less the time
+// spent since processing downstream stages inline.
+inline thread_local std::uint64_t tl_inlineBudgetNs{0};
+
+enum class Step : uint8_t
+{
+    Processed, // An input was processed, or the generator produced an output.
+    Starved,   // No input was available.
+    Finished   // The stage met the end of the stream or a closed buffer.
+};
+
 } // namespace detail
 
-template <class IN, class OUT> class Stage
+template <class IN, class OUT>
+class Stage final : detail::PushListener,
+                    detail::InlineConsumer<std::future<IN>>,
+                    detail::CoDriver
 {
+    enum SchedState : int
+    {
+        Idle,      // Not scheduled, waiting for input.
+        Scheduled, // A task is posted to the executor.
+        Running,   // A task is processing input.
+        Notified,  // Input arrived while running, so the task runs again.
+        Parked,    // A coroutine suspended, the task runs when it finishes.
+        Done       // The stream ended, no further tasks until restarted.
+    };
+
+    // Items processed by a task before yielding its executor thread.
+    static constexpr std::size_t kSliceItems = 32;
+
+    Placement const _placement;
+    std::optional<ArenaOptions> const _arenaOptions;
     Callable<IN, OUT> _operation;
+    StageContext _context;
     std::shared_ptr<BufferQueue<std::future<IN>>> _input;
     std::shared_ptr<BufferQueue<std::future<OUT>>> _output;
-    std::thread _worker;
+    std::jthread _worker;
     std::mutex _cmdMtx;
     std::atomic_bool _alive{false};
 
+    // Requested to cease the current run. Blocking pops and operations that
+    // accept the token return early when it's requested.
+    std::stop_source _stop;
+    std::stop_token _stopToken;
+
+    // The worker thread parks on a gate between runs, instead of exiting, so
+    // that resuming a paused stage doesn't spawn a thread. Stopping the
+    // thread itself retires it.
+    std::mutex _gateMtx;
+    std::condition_variable_any _gate;
+    std::uint64_t _runs{0};
+    bool _gated{false};
+
+    detail::WorkStealingPool *_executor{nullptr};
+    std::shared_ptr<detail::Tenant> _tenant;
+    std::atomic_int _sched{Idle};
+
+    detail::FusionController *_fusion{nullptr};
+    detail::StageProfile *_profile{nullptr};
+
+    // Opportunistic inline handoff, with the time per item of downstream
+    // stages processed inline.
+    bool _opportunistic{false};
+    std::uint64_t _inlineCostNs{0};
+
+    // Run-to-completion mode: sequence number of the next token to serve.
+    bool const _parallel;
+    std::atomic_uint64_t _turn{0};
+
+    // Coroutine stage in executor mode: the coroutine of the current item,
+    // and the parties yet to see it suspended or finished, i.e. the task that
+    // started it and the coroutine itself.
+    bool _suspendable;
+    std::optional<Task<OUT>> _parked;
+    std::atomic_int _parkRefs{0};
+
+    // Hot swap: the operation to adopt between items, and the one it
+    // replaced, which is destroyed off the hot path.
+    std::mutex _swapMtx;
+    std::atomic_bool _swapPending{false};
+    Callable<IN, OUT> _next, _retired;
+    bool _nextSuspendable{false};
+
+    // Whether the start hook ran without the stop hook, and whether a worker
+    // ran it in the current run. The latter is guarded by the gate mutex.
+    bool _hooked{false};
+    bool _warm{false};
+
+    // Executor mode: invoked once when the tasks of the stage see the end of
+    // the stream.
+    std::mutex _doneMtx;
+    std::function<void()> _onDone;
+
+    // Arena of an ArenaBacked operation, reset between items. Stateless
+    // stages in run-to-completion mode borrow one per token worker instead.
+    std::unique_ptr<detail::ItemArena> _arena;
+    std::mutex _spareArenasMtx;
+    std::vector<std::unique_ptr<detail::ItemArena>> _spareArenas;
+
   public:
     template <class F>
-    explicit Stage(F &&operation) : _operation(std::forward<F>(operation))
+    explicit Stage(F &&operation)
+        : _placement(detail::placementOf(operation)),
+          _arenaOptions(detail::arenaOf(operation)),
+          _operation(std::forward<F>(operation)),
+          _parallel(detail::stateless_op<F>),
+          _suspendable(detail::coroutine_stage<F, IN>())
     {
+        if (_arenaOptions)
+        {
+            _arena = std::make_unique<detail::ItemArena>(*_arenaOptions);
+            _context._arena = _arena->resource();
+        }
     }
 
-    ~Stage()
+    ~Stage() override
     {
-        stop();
+        halt();
+
+        if (_worker.joinable())
+        {
+            _worker.request_stop();
+            _worker.join();
+        }
+    }
+
+    /**
+     * @brief Record the time spent in each part of the processing cycle. The
+     * generator also reports produced items to the fusion controller.
+     */
+    void probe(detail::FusionController *fusion, detail::StageProfile *profile)
+    {
+        std::lock_guard lk(_cmdMtx);
+        _fusion = fusion;
+        _profile = profile;
     }
 
+    /**
+     * @brief Start processing. Without an executor the stage runs on a
+     * dedicated thread, otherwise it runs as a task on the executor each time
+     * input is available. Tasks of a tenant run on its share of the executor.
+     * The thread of a stage that ran before is reused.
+     */
     void start(std::shared_ptr<BufferQueue<std::future<IN>>> input,
-               std::shared_ptr<BufferQueue<std::future<OUT>>> output)
+               std::shared_ptr<BufferQueue<std::future<OUT>>> output,
+               StageContext context = StageContext{},
+               detail::WorkStealingPool *executor = nullptr,
+               std::shared_ptr<detail::Tenant> tenant = nullptr)
     {
         std::lock_guard lk(_cmdMtx);
         if (!_alive)
         {
             _input = std::move(input);
             _output = std::move(output);
+            _context = std::move(context);
+            _context._arena = _arena ? _arena->resource() : nullptr;
+            _executor = executor;
+            _tenant = std::move(tenant);
 
+            adopt();
+            _stop = std::stop_source{};
+            _stopToken = _stop.get_token();
+            _context._stop = _stopToken;
             _alive = true;
-            _worker = std::thread(&Stage::process, this);
+            if (_executor)
+            {
+                warmUp(); // Executor threads are shared, so hooks run here.
+                _sched = Idle;
+                if constexpr (!std::is_void_v<IN>)
+                {
+                    _input->listen(this);
+                }
+                onPush(); // Schedule the first task.
+            }
+            else
+            {
+                if constexpr (!std::is_void_v<IN>)
+                {
+                    _input->attach(this);
+                }
+                std::unique_lock lk(_gateMtx);
+                _gated = false;
+                _warm = false;
+                if (_worker.joinable())
+                {
+                    ++_runs; // Release the parked worker.
+                    lk.unlock();
+                    _gate.notify_all();
+                }
+                else
+                {
+                    _worker = std::jthread(
+                        [this](std::stop_token retire) { process(retire); });
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Attach the buffers of the stage without starting to process, so
+     * that the caller drives processing with poll().
+     */
+    void bind(std::shared_ptr<BufferQueue<std::future<IN>>> input,
+              std::shared_ptr<BufferQueue<std::future<OUT>>> output,
+              StageContext context = StageContext{})
+    {
+        std::lock_guard lk(_cmdMtx);
+        if (!_alive)
+        {
+            _input = std::move(input);
+            _output = std::move(output);
+            _context = std::move(context);
+            _context._arena = _arena ? _arena->resource() : nullptr;
         }
     }
 
-    auto stop()
+    /**
+     * @brief Process one input, or invoke the generator once, on the calling
+     * thread. Expects the stage not to be started.
+     */
+    detail::Step poll()
+    {
+        return step(false);
+    }
+
+    /**
+     * @brief Request processing to cease, without waiting. A worker blocked
+     * on its input returns immediately, and operations accepting the stop
+     * token of the stage are asked to return early. Followed by halt() to
+     * wait until the operation is no longer invoked.
+     */
+    void stop()
+    {
+        _stop.request_stop();
+    }
+
+    // Cease processing and wait until the operation is no longer invoked.
+    void halt()
     {
-        return std::async([this] {
-            std::lock_guard lk(_cmdMtx);
-            if (_alive)
+        std::lock_guard lk(_cmdMtx);
+        if (_alive)
+        {
+            _alive = false;
+            _stop.request_stop();
+            release();
+            if (_executor)
             {
-                _alive = false;
-                _worker.join();
+                coolDown();
+
+                // The stream won't end in this run, which ends anyway.
+                std::unique_lock dlk(_doneMtx);
+                if (auto done = std::exchange(_onDone, nullptr))
+                {
+                    dlk.unlock();
+                    done();
+                }
             }
-        });
+            collect();
+        }
     }
 
     // Let the worker run, until it exits due to ClosedBuffer error.
@@ -223,21 +532,688 @@ template <class IN, class OUT> class Stage
         std::lock_guard lk(_cmdMtx);
         if (_alive)
         {
-            _worker.join();
+            release(true);
             _alive = false;
+            if (_executor)
+            {
+                coolDown();
+            }
+            collect();
         }
     }
 
-  private:
-    void process()
+    /**
+     * @brief Executor mode: invoke done once the stage has processed the end
+     * of the stream, or right away if it already has. Also invoked if the
+     * stage is halted first. The callback may run on an executor thread, so
+     * it must not wait for the pipeline.
+     */
+    void whenDone(std::function<void()> done)
     {
-        while (_alive)
         {
-            if (!detail::process(_operation, _input, _output))
+            std::lock_guard lk(_doneMtx);
+            if (Done != _sched.load())
+            {
+                _onDone = std::move(done);
+                return;
+            }
+        }
+        done();
+    }
+
+    /**
+     * @brief Invoke the start hook of the operation, unless it already ran.
+     * A worker thread does so itself, before processing its first item.
+     */
+    void warmUp()
+    {
+        if (!_hooked)
+        {
+            _hooked = true;
+            try
+            {
+                _operation.onStart();
+            }
+            catch (...)
+            {
+                // A failed warm-up only costs the latency it would save.
+            }
+        }
+    }
+
+    /**
+     * @brief Invoke the stop hook of the operation, if the start hook ran. A
+     * worker thread does so itself, after processing its last item.
+     */
+    void coolDown()
+    {
+        if (_hooked)
+        {
+            _hooked = false;
+            try
+            {
+                _operation.onStop();
+            }
+            catch (...)
+            {
+                // Processing ceases regardless.
+            }
+        }
+    }
+
+    /**
+     * @brief Wait until the worker thread of a started stage has run the
+     * start hook, or has parked already. Returns at once in other modes.
+     */
+    void awaitWarm()
+    {
+        std::lock_guard lk(_cmdMtx);
+        if (_alive && !_executor)
+        {
+            std::unique_lock gate(_gateMtx);
+            _gate.wait(gate, [this] { return _warm || _gated; });
+        }
+    }
+
+    /**
+     * @brief Swap the operation of the stage. Processing switches to the new
+     * operation between items, while the current item finishes with the old
+     * one. The old operation is destroyed by the next replacement, or when
+     * processing ceases, so never on the thread processing items. A stage
+     * that is not processing adopts the replacement when settled.
+     */
+    template <class F> void replace(F &&operation)
+    {
+        if constexpr (std::is_void_v<IN>)
+        {
+            static_assert(std::is_same_v<op_result_t<F>, OUT>,
+                          "A replacement must produce the same output");
+        }
+        else
+        {
+            static_assert(std::is_same_v<op_result_t<F, IN>, OUT>,
+                          "A replacement must produce the same output");
+        }
+        if (detail::stateless_op<F> != _parallel)
+        {
+            throw std::invalid_argument(
+                "A replacement must keep the stateless marker");
+        }
+
+        Callable<IN, OUT> next(std::forward<F>(operation));
+        Callable<IN, OUT> garbage, superseded;
+        {
+            std::lock_guard lk(_swapMtx);
+            garbage = std::move(_retired);
+            superseded = std::move(_next);
+            _next = std::move(next);
+            _nextSuspendable = detail::coroutine_stage<F, IN>();
+            _swapPending.store(true, std::memory_order_release);
+        }
+    }
+
+    /**
+     * @brief Adopt a pending replacement, while no item is being processed.
+     */
+    void adoptReplacement()
+    {
+        std::lock_guard lk(_cmdMtx);
+        adopt();
+        collect();
+    }
+
+    /**
+     * @brief Process outputs on the producing thread, instead of queuing them,
+     * while the downstream stage is idle and this thread idled waiting for
+     * input at least as long as processing them takes.
+     */
+    void handoffWhenIdle(bool enable)
+    {
+        std::lock_guard lk(_cmdMtx);
+        _opportunistic = enable;
+    }
+
+    /**
+     * @brief Run-to-completion mode: invoke the generator on the calling
+     * thread, collecting its outputs.
+     *
+     * @return False when the generator is exhausted.
+     */
+    bool generate(std::vector<OUT> &batch)
+    {
+        adopt();
+        auto collect = [&batch](OUT &&item) {
+            batch.push_back(std::move(item));
+        };
+        try
+        {
+            _operation(_context, detail::Emitter<OUT>(collect));
+        }
+        catch (GeneratorExit &)
+        {
+            return recycle(false);
+        }
+        catch (...)
+        {
+            // Op threw an exception. No point in propagating the data.
+        }
+        return recycle(true);
+    }
+
+    /**
+     * @brief Run-to-completion mode: process the items carried by token seq
+     * on the calling thread, passing the outputs to collect. Unless the
+     * operation is stateless, tokens are served one at a time in sequence
+     * order, even if they carry no items. A token carrying a flush barrier
+     * invokes the barrier hook of the operation in its turn.
+     *
+     * @return False if the operation ended the stream.
+     */
+    template <class C>
+    bool serve(std::uint64_t seq, std::vector<IN> batch, C &&collect,
+               bool barrier = false)
+    {
+        if (!_parallel)
+        {
+            for (auto turn = _turn.load(); turn != seq; turn = _turn.load())
+            {
+                _turn.wait(turn);
+            }
+            adopt(); // Stateless stages adopt replacements when started.
+        }
+
+        // Concurrent tokens of a stateless stage need arenas of their own.
+        auto *arena = _arena.get();
+        std::unique_ptr<detail::ItemArena> borrowed;
+        std::optional<StageContext> context;
+        if (_parallel && _arena)
+        {
+            borrowed = borrowArena();
+            arena = borrowed.get();
+            context.emplace(_context);
+            context->_arena = arena->resource();
+        }
+        auto &ctx = context ? *context : _context;
+
+        bool keepProcessing = true;
+        for (auto &item : batch)
+        {
+            try
+            {
+                if constexpr (std::is_void_v<OUT>)
+                {
+                    _operation(std::move(item), ctx, detail::Emitter<void>{});
+                }
+                else
+                {
+                    _operation(std::move(item), ctx,
+                               detail::Emitter<OUT>(collect));
+                }
+            }
+            catch (GeneratorExit &)
+            {
+                keepProcessing = false;
+            }
+            catch (...)
+            {
+                // Op threw an exception. No point in propagating the data.
+            }
+
+            if (arena)
+            {
+                arena->itemDone();
+            }
+            if (!keepProcessing)
             {
                 break;
             }
         }
+
+        if (borrowed)
+        {
+            std::lock_guard lk(_spareArenasMtx);
+            _spareArenas.push_back(std::move(borrowed));
+        }
+
+        if (barrier)
+        {
+            try
+            {
+                _operation.onBarrier();
+            }
+            catch (...)
+            {
+                // A failed hook doesn't hold the barrier back.
+            }
+        }
+
+        if (!_parallel)
+        {
+            _turn.store(seq + 1);
+            _turn.notify_all();
+        }
+        return keepProcessing;
+    }
+
+  private:
+    // An item was processed, so its transient allocations can be reclaimed.
+    bool recycle(bool keepProcessing)
+    {
+        if (_arena)
+        {
+            _arena->itemDone();
+        }
+        return keepProcessing;
+    }
+
+    std::unique_ptr<detail::ItemArena> borrowArena()
+    {
+        {
+            std::lock_guard lk(_spareArenasMtx);
+            if (!_spareArenas.empty())
+            {
+                auto ret = std::move(_spareArenas.back());
+                _spareArenas.pop_back();
+                return ret;
+            }
+        }
+        return std::make_unique<detail::ItemArena>(*_arenaOptions);
+    }
+
+    // Switch to a pending replacement of the operation. Only called between
+    // items, by the thread processing them.
+    void adopt()
+    {
+        if (_swapPending.load(std::memory_order_acquire))
+        {
+            bool hooked = _hooked;
+            coolDown();
+            {
+                std::lock_guard lk(_swapMtx);
+                std::swap(_operation, _next);
+                std::swap(_retired, _next); // Empty since the last swap.
+                _suspendable = _nextSuspendable;
+                _swapPending.store(false, std::memory_order_relaxed);
+            }
+            if (hooked)
+            {
+                warmUp();
+            }
+        }
+    }
+
+    // Destroy the operation replaced last, if any.
+    void collect()
+    {
+        Callable<IN, OUT> garbage;
+        std::lock_guard lk(_swapMtx);
+        garbage = std::move(_retired);
+    }
+
+    // Wait for the thread to park or the tasks to settle. Tasks settle when
+    // the stage starves, unless waiting for the end of the stream.
+    void release(bool untilDone = false)
+    {
+        if (_executor)
+        {
+            for (int s = _sched.load(); Done != s && (untilDone || Idle != s);
+                 s = _sched.load())
+            {
+                _sched.wait(s);
+            }
+            if constexpr (!std::is_void_v<IN>)
+            {
+                _input->listen(nullptr);
+            }
+        }
+        else
+        {
+            {
+                std::unique_lock lk(_gateMtx);
+                _gate.wait(lk, [this] { return _gated; });
+            }
+            if constexpr (!std::is_void_v<IN>)
+            {
+                _input->attach(nullptr);
+            }
+        }
+    }
+
+    detail::Step step(bool wait)
+    {
+        if constexpr (std::is_void_v<IN>)
+        {
+            return produce() ? detail::Step::Processed
+                             : detail::Step::Finished;
+        }
+        else
+        {
+            std::future<IN> item;
+            try
+            {
+                if (wait && !_profile && !_opportunistic)
+                {
+                    item = _input->pop(_stopToken);
+                }
+                else if (auto next = timedTryPop())
+                {
+                    item = std::move(*next);
+                    detail::tl_inlineBudgetNs = 0;
+                }
+                else if (wait)
+                {
+                    auto start = detail::profile_clock::now();
+                    item = _input->pop(_stopToken);
+                    detail::tl_inlineBudgetNs = detail::elapsedNs(start);
+                }
+                else
+                {
+                    return detail::Step::Starved;
+                }
+            }
+            catch (detail::ClosedError &)
+            {
+                return detail::Step::Finished;
+            }
+
+            return consumeItem(std::move(item)) ? detail::Step::Processed
+                                                : detail::Step::Finished;
+        }
+    }
+
+    // Pop an available input. Only pops that find input are timed, since
+    // waiting for input is not part of the link overhead.
+    auto timedTryPop()
+    {
+        if (!_profile)
+        {
+            return _input->tryPop();
+        }
+
+        auto start = detail::profile_clock::now();
+        auto ret = _input->tryPop();
+        if (ret)
+        {
+            _profile->popNs += detail::elapsedNs(start);
+            ++_profile->pops;
+        }
+        return ret;
+    }
+
+    // Pass an output downstream.
+    void emit(std::future<OUT> item)
+    {
+        if constexpr (!std::is_void_v<OUT>)
+        {
+            auto &budget = detail::tl_inlineBudgetNs;
+            if (_opportunistic && budget > _inlineCostNs)
+            {
+                auto start = detail::profile_clock::now();
+                if (_output->offer(item))
+                {
+                    auto ns = detail::elapsedNs(start);
+                    budget -= std::min(budget, ns);
+                    _inlineCostNs = (3 * _inlineCostNs + ns) / 4;
+                    if (_profile)
+                    {
+                        _profile->inlineNs += ns;
+                    }
+                    return;
+                }
+            }
+
+            if (!_profile)
+            {
+                _output->push(std::move(item));
+                return;
+            }
+
+            auto start = detail::profile_clock::now();
+            bool handedOver = _output->push(std::move(item));
+            auto ns = detail::elapsedNs(start);
+            if (handedOver)
+            {
+                _profile->inlineNs += ns;
+            }
+            else
+            {
+                _profile->pushNs += ns;
+                ++_profile->pushes;
+            }
+        }
+    }
+
+    bool produce()
+    {
+        adopt();
+        auto push = [this](std::future<OUT> item) { emit(std::move(item)); };
+        if (_suspendable && _executor)
+        {
+            return launch(push);
+        }
+        if (!_profile)
+        {
+            return recycle(detail::process(_operation, _context, push));
+        }
+
+        auto start = detail::profile_clock::now();
+        bool ret = detail::process(_operation, _context, push);
+        _profile->busyNs += detail::elapsedNs(start);
+        ++_profile->items;
+
+        if (_fusion)
+        {
+            _fusion->tick();
+        }
+        return recycle(ret);
+    }
+
+    bool consumeItem(std::future<IN> item)
+    {
+        adopt();
+        auto push = [this](std::future<OUT> item) { emit(std::move(item)); };
+        if (_suspendable && _executor)
+        {
+            return launch(push, std::move(item));
+        }
+        if (!_profile)
+        {
+            return recycle(detail::process(_operation, _context,
+                                           std::move(item), push));
+        }
+
+        auto start = detail::profile_clock::now();
+        bool ret =
+            detail::process(_operation, _context, std::move(item), push);
+        _profile->busyNs += detail::elapsedNs(start);
+        ++_profile->items;
+        return recycle(ret);
+    }
+
+    // Run the coroutine of an item until it first suspends.
+    template <class P, class... In> bool launch(P &push, In... input)
+    {
+        auto park = [this](Task<OUT> task) {
+            _parked.emplace(std::move(task));
+            _parkRefs = 2;
+            _parked->start(*this);
+        };
+        return detail::launch(_operation, _context, push, park,
+                              std::move(input)...);
+    }
+
+    // Pass the result of the parked coroutine downstream.
+    detail::Step unpark()
+    {
+        auto push = [this](std::future<OUT> item) { emit(std::move(item)); };
+        bool keepProcessing = detail::finish(*_parked, push);
+        _parked.reset();
+        return recycle(keepProcessing) ? detail::Step::Processed
+                              : detail::Step::Finished;
+    }
+
+    // Resume the parked coroutine on the executor.
+    void schedule(std::coroutine_handle<> h) override
+    {
+        _executor->post([h] { h.resume(); }, _tenant);
+    }
+
+    // The parked coroutine finished. Processing continues once the task that
+    // started it has yielded its thread.
+    void complete() override
+    {
+        if (1 == _parkRefs.fetch_sub(1))
+        {
+            _executor->post([this] { resumeSlice(); }, _tenant);
+        }
+    }
+
+    void resumeSlice()
+    {
+        if (detail::Step::Finished == unpark())
+        {
+            return settle(Done);
+        }
+        runSlice();
+    }
+
+    // Process an item on the thread that pushed it, while the worker of this
+    // stage is parked waiting for input.
+    bool consumeInline(std::future<IN> item) override
+    {
+        if constexpr (std::is_void_v<IN>)
+        {
+            return false; // Generators have no input.
+        }
+        else
+        {
+            return consumeItem(std::move(item));
+        }
+    }
+
+    void process(std::stop_token retire)
+    {
+        detail::place(_placement);
+
+        std::uint64_t runs = 0;
+        while (true)
+        {
+            warmUp();
+            {
+                std::lock_guard lk(_gateMtx);
+                _warm = true;
+            }
+            _gate.notify_all();
+
+            while (!_stopToken.stop_requested())
+            {
+                if (detail::Step::Finished == step(true))
+                {
+                    break;
+                }
+            }
+            coolDown();
+
+            // Park until the stage is started again or destroyed.
+            std::unique_lock lk(_gateMtx);
+            _gated = true;
+            _gate.notify_all();
+            if (!_gate.wait(lk, retire, [&] { return _runs != runs; }))
+            {
+                return;
+            }
+            runs = _runs;
+        }
+    }
+
+    // Input arrived. Make sure a task will process it.
+    void onPush() override
+    {
+        int s = _sched.load();
+        while (true)
+        {
+            if (Idle == s)
+            {
+                if (_sched.compare_exchange_weak(s, Scheduled))
+                {
+                    _executor->post([this] { runSlice(); }, _tenant);
+                    return;
+                }
+            }
+            else if (Running == s)
+            {
+                if (_sched.compare_exchange_weak(s, Notified))
+                {
+                    return;
+                }
+            }
+            else
+            {
+                return; // Already scheduled, or done.
+            }
+        }
+    }
+
+    void settle(int state)
+    {
+        std::function<void()> done;
+        {
+            std::lock_guard lk(_doneMtx);
+            if (Done == state)
+            {
+                done = std::exchange(_onDone, nullptr);
+            }
+            _sched.store(state);
+        }
+        _sched.notify_all();
+
+        if (done)
+        {
+            done();
+        }
+    }
+
+    void runSlice()
+    {
+        _sched.store(Running);
+
+        for (std::size_t i(0); i < kSliceItems; ++i)
+        {
+            if (_stopToken.stop_requested())
+            {
+                return settle(Idle);
+            }
+
+            auto result = step(false);
+            if (_parked)
+            {
+                _sched.store(Parked);
+                if (1 != _parkRefs.fetch_sub(1))
+                {
+                    return; // Suspended, complete() resumes processing.
+                }
+                _sched.store(Running);
+                result = unpark();
+            }
+            if (detail::Step::Finished == result)
+            {
+                return settle(Done);
+            }
+            if (detail::Step::Starved == result)
+            {
+                int s = Running;
+                if (_sched.compare_exchange_strong(s, Idle))
+                {
+                    _sched.notify_all();
+                    return;
+                }
+                break; // Input arrived after the last attempt to pop.
+            }
+        }
+
+        // Yield the executor thread to other tasks.
+        _sched.store(Scheduled);
+        _executor->defer([this] { runSlice(); }, _tenant);
     }
 };
 
@@ -0,0 +1,266 @@
+// © 2022 Nikolaos Athanasiou, github.com/picanumber
+#pragma once
+
+#include "buffer_queue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace yap
+{
+
+namespace detail
+{
+
+/**
+ * @brief Threads available to stages for intra-item data parallelism. Threads
+ * are only spawned the first time work is posted, so pipelines that never
+ * split their items pay nothing.
+ */
+class WorkerPool
+{
+    std::size_t _size;
+    std::vector<std::thread> _threads;
+    BufferQueue<std::function<void()>> _tasks;
+    std::once_flag _spawned;
+
+  public:
+    explicit WorkerPool(std::size_t size) : _size(size)
+    {
+    }
+
+    WorkerPool(WorkerPool const &) = delete;
+    WorkerPool &operator=(WorkerPool const &) = delete;
+
+    ~WorkerPool()
+    {
+        _tasks.set(BufferBehavior::Closed);
+        for (auto &t : _threads)
+        {
+            t.join();
+        }
+    }
+
+    std::size_t size() const noexcept
+    {
+        return _size;
+    }
+
+    void post(std::function<void()> task)
+    {
+        std::call_once(_spawned, [this] {
+            _threads.reserve(_size);
+            for (std::size_t i(0); i < _size; ++i)
+            {
+                _threads.emplace_back(&WorkerPool::work, this);
+            }
+        });
+
+        _tasks.push(std::move(task));
+    }
+
+  private:
+    void work()
+    {
+        try
+        {
+            while (true)
+            {
+                _tasks.pop()();
+            }
+        }
+        catch (ClosedError &)
+        {
+            // The pool is being destroyed.
+        }
+    }
+};
+
+/**
+ * @brief A loop split into chunks. Chunks are claimed by the thread issuing
+ * the loop and by any helper thread that joins in.
+ */
+class ParallelLoop
+{
+    std::function<void(std::size_t)> _body;
+    std::size_t _first, _last, _grain, _nChunks;
+
+    std::atomic_size_t _nextChunk{0};
+    std::size_t _doneChunks{0};
+    std::exception_ptr _error;
+    std::mutex _mtx;
+    std::condition_variable _done;
+
+  public:
+    ParallelLoop(std::function<void(std::size_t)> body, std::size_t first,
+                 std::size_t last, std::size_t grain)
+        : _body(std::move(body)), _first(first), _last(last), _grain(grain),
+          _nChunks((last - first + grain - 1) / grain)
+    {
+    }
+
+    std::size_t chunks() const noexcept
+    {
+        return _nChunks;
+    }
+
+    // Process chunks until none is left unclaimed.
+    void work()
+    {
+        for (auto chunk = _nextChunk++; chunk < _nChunks; chunk = _nextChunk++)
+        {
+            std::exception_ptr error;
+            try
+            {
+                auto begin = _first + chunk * _grain;
+                auto end = std::min(_last, begin + _grain);
+                for (auto i = begin; i < end; ++i)
+                {
+                    _body(i);
+                }
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+
+            std::lock_guard lk(_mtx);
+            if (error && !_error)
+            {
+                _error = error;
+            }
+            if (++_doneChunks == _nChunks)
+            {
+                _done.notify_all();
+            }
+        }
+    }
+
+    // Wait for all chunks to finish and report the first error, if any.
+    void wait()
+    {
+        std::unique_lock lk(_mtx);
+        _done.wait(lk, [this] { return _doneChunks == _nChunks; });
+
+        if (_error)
+        {
+            std::rethrow_exception(_error);
+        }
+    }
+};
+
+} // namespace detail
+
+template <class IN, class OUT> class Stage;
+
+/**
+ * @brief Facilities the pipeline offers to the operation of a stage. An
+ * operation opts in by accepting a "StageContext &" as its last argument.
+ */
+class StageContext
+{
+    template <class, class> friend class Stage;
+
+    std::shared_ptr<detail::WorkerPool> _pool;
+    std::stop_token _stop;
+    std::pmr::memory_resource *_arena{nullptr};
+
+  public:
+    StageContext() = default;
+
+    explicit StageContext(std::shared_ptr<detail::WorkerPool> pool)
+        : _pool(std::move(pool))
+    {
+    }
+
+    /**
+     * @brief Number of threads that can work on a parallel loop, including
+     * the thread of the stage.
+     */
+    std::size_t concurrency() const noexcept
+    {
+        return 1 + (_pool ? _pool->size() : 0);
+    }
+
+    /**
+     * @brief Requested when the stage is stopped or paused. Long running
+     * operations poll it, or register a std::stop_callback, to return early.
+     * Operations that only need the token can accept a "std::stop_token" as
+     * their last argument instead of the context.
+     */
+    std::stop_token stopToken() const noexcept
+    {
+        return _stop;
+    }
+
+    /**
+     * @brief Memory for allocations that don't outlive the current item. It
+     * comes from the arena of the stage, if the operation is ArenaBacked, and
+     * from the default resource otherwise.
+     */
+    std::pmr::memory_resource *arena() const noexcept
+    {
+        return _arena ? _arena : std::pmr::get_default_resource();
+    }
+
+    /**
+     * @brief Invoke body(i) for every i in [first, last), using the worker
+     * pool of the pipeline alongside the thread of the stage. Blocks until
+     * the whole range is processed. The first exception thrown by the body is
+     * rethrown after all iterations finish.
+     *
+     * @param grain Number of consecutive indices processed as a single task.
+     * When zero, the range is split into a few chunks per available thread.
+     */
+    template <class F>
+    void parallel_for(std::size_t first, std::size_t last, F &&body,
+                      std::size_t grain = 0)
+    {
+        if (last <= first)
+        {
+            return;
+        }
+
+        if (0 == grain)
+        {
+            grain = std::max<std::size_t>(
+                1, (last - first) / (4 * concurrency()));
+        }
+
+        if (1 == concurrency() || last - first <= grain)
+        {
+            for (auto i = first; i < last; ++i)
+            {
+                body(i);
+            }
+            return;
+        }
+
+        // The body is only referenced while chunks are left to process, and
+        // the issuing thread waits for those. Late helpers find nothing to do.
+        auto loop = std::make_shared<detail::ParallelLoop>(
+            [&body](std::size_t i) { body(i); }, first, last, grain);
+
+        auto nHelpers = std::min(_pool->size(), loop->chunks() - 1);
+        for (std::size_t i(0); i < nHelpers; ++i)
+        {
+            _pool->post([loop] { loop->work(); });
+        }
+
+        loop->work();
+        loop->wait();
+    }
+};
+
+} // namespace yap
@@ -0,0 +1,230 @@
+// © 2022 Nikolaos Athanasiou, github.com/picanumber
+#pragma once
+
+#include "runtime_utilities.h"
+#include "stage_context.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace yap
+{
+
+/**
+ * @brief Selects the run-to-completion mode of a pipeline: a number of
+ * tokens, each one carried by its own worker thread, take an item from the
+ * generator through every stage before taking the next one. Items stay in
+ * the cache of a single core for their whole lifetime.
+ */
+struct Tokens
+{
+    // Items in flight, and the number of workers carrying them.
+    std::size_t count = std::thread::hardware_concurrency();
+};
+
+/**
+ * @brief Marks an operation that keeps no state between invocations and can
+ * be invoked concurrently. In run-to-completion mode such a stage processes
+ * items out of order, while all other stages process one token at a time in
+ * the order items were generated. Other modes ignore the marker.
+ *
+ * @tparam F Type of the wrapped operation.
+ */
+template <class F> class Stateless
+{
+    F _op;
+
+  public:
+    using emitting_tag = void;
+    using stateless_tag = void;
+
+    template <class... Args> using output_t = op_result_t<F, Args...>;
+
+    explicit Stateless(F op) : _op(std::move(op))
+    {
+    }
+
+    template <class E, class... Args>
+    void feed(StageContext &ctx, E &&emit, Args &&...args)
+    {
+        detail::apply_op(_op, ctx, emit, std::forward<Args>(args)...);
+    }
+
+    void on_start()
+        requires detail::start_hook<F>
+    {
+        _op.on_start();
+    }
+
+    void on_stop()
+        requires detail::stop_hook<F>
+    {
+        _op.on_stop();
+    }
+
+    void on_barrier()
+        requires detail::barrier_hook<F>
+    {
+        _op.on_barrier();
+    }
+};
+
+template <class F> Stateless(F) -> Stateless<F>;
+
+namespace detail
+{
+
+template <class F>
+concept stateless_op =
+    requires { typename std::remove_cvref_t<F>::stateless_tag; };
+
+/**
+ * @brief Workers of a pipeline in run-to-completion mode. Every token takes
+ * a sequence number from the generator, which orders its turn on serial
+ * stages.
+ */
+class TokenCrew
+{
+    std::size_t _count;
+    std::vector<std::thread> _workers;
+    std::atomic_bool _stopping{false};
+    std::atomic_size_t _active{0};
+
+    std::mutex _generatorMtx;
+    std::uint64_t _nextSeq{0};
+    bool _exhausted{false};
+    std::deque<Barrier> _barriers; // Flush barriers yet to take a token.
+
+  public:
+    explicit TokenCrew(std::size_t count)
+        : _count(std::max<std::size_t>(1, count))
+    {
+    }
+
+    TokenCrew(TokenCrew const &) = delete;
+    TokenCrew &operator=(TokenCrew const &) = delete;
+
+    ~TokenCrew()
+    {
+        stop();
+    }
+
+    std::size_t size() const noexcept
+    {
+        return _count;
+    }
+
+    bool stopping() const noexcept
+    {
+        return _stopping;
+    }
+
+    // Spawn the workers, each one invoking carry until it returns false. The
+    // last worker to exit invokes ended, unless the crew was stopped.
+    void start(std::function<bool()> carry,
+               std::function<void()> ended = nullptr)
+    {
+        _stopping = false;
+        _exhausted = false;
+        _active = _count;
+
+        for (std::size_t i(0); i < _count; ++i)
+        {
+            _workers.emplace_back([this, carry, ended] {
+                while (!_stopping && carry())
+                {
+                }
+                if (1 == _active.fetch_sub(1) && !_stopping && ended)
+                {
+                    ended();
+                }
+            });
+        }
+    }
+
+    // Let the workers finish the tokens they carry and exit.
+    void stop()
+    {
+        _stopping = true;
+        join();
+    }
+
+    // Wait until the workers exit, i.e. at the end of the stream.
+    void join()
+    {
+        for (auto &w : _workers)
+        {
+            w.join();
+        }
+        _workers.clear();
+    }
+
+    /**
+     * @brief Invoke the generator and assign the next sequence number to its
+     * outputs. Returns false once the stream has ended.
+     *
+     * @param produce Returns false when the generator is exhausted.
+     * @param barrier Receives a pending flush barrier instead, which takes
+     * the sequence number without invoking the generator.
+     */
+    template <class G>
+    bool generate(G &&produce, std::uint64_t &seq,
+                  std::optional<Barrier> &barrier)
+    {
+        std::lock_guard lk(_generatorMtx);
+        if (_exhausted)
+        {
+            return false;
+        }
+        if (!_barriers.empty())
+        {
+            barrier.emplace(std::move(_barriers.front()));
+            _barriers.pop_front();
+            seq = _nextSeq++;
+            return true;
+        }
+        if (!produce())
+        {
+            _exhausted = true;
+            return false;
+        }
+
+        seq = _nextSeq++;
+        return true;
+    }
+
+    // Stop generating, e.g. when a stage ends the stream.
+    void exhaust()
+    {
+        std::lock_guard lk(_generatorMtx);
+        _exhausted = true;
+    }
+
+    // Carry a flush barrier with the next token. Barriers wait for the next
+    // run if the stream has ended.
+    void flush(Barrier barrier)
+    {
+        std::lock_guard lk(_generatorMtx);
+        _barriers.push_back(std::move(barrier));
+    }
+
+    // Drop pending flush barriers, breaking their promises.
+    void dropBarriers()
+    {
+        std::lock_guard lk(_generatorMtx);
+        _barriers.clear();
+    }
+};
+
+} // namespace detail
+
+} // namespace yap
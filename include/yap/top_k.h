@@ -0,0 +1,351 @@
+// © 2022 Nikolaos Athanasiou, github.com/picanumber
+#pragma once
+
+#include "topology.h"
+
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ranges>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace yap
+{
+
+namespace detail
+{
+
+/**
+ * @brief Min-heap of counters, indexed by key. Allows O(log n) updates of the
+ * counter of any key and O(1) access to the least frequent key.
+ */
+template <class Key, class Hash, class Eq> class IndexedMinHeap
+{
+  public:
+    struct Entry
+    {
+        Key key;
+        std::size_t count;
+        std::size_t error; // Overestimation bound of the count.
+    };
+
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+  private:
+    std::vector<Entry> _heap;
+    std::unordered_map<Key, std::size_t, Hash, Eq> _position;
+
+  public:
+    std::size_t size() const noexcept
+    {
+        return _heap.size();
+    }
+
+    Entry const &top() const
+    {
+        return _heap.front();
+    }
+
+    std::size_t find(Key const &key) const
+    {
+        auto it = _position.find(key);
+        return it == _position.end() ? npos : it->second;
+    }
+
+    void push(Key const &key, std::size_t count, std::size_t error)
+    {
+        _heap.push_back(Entry{key, count, error});
+        _position.emplace(key, _heap.size() - 1);
+        siftUp(_heap.size() - 1);
+    }
+
+    // Counters only grow, so an updated entry can only move to the leaves.
+    void increase(std::size_t pos, std::size_t count)
+    {
+        _heap[pos].count += count;
+        siftDown(pos);
+    }
+
+    void replaceTop(Key const &key, std::size_t count, std::size_t error)
+    {
+        _position.erase(_heap.front().key);
+        _heap.front() = Entry{key, count, error};
+        _position.emplace(key, 0);
+        siftDown(0);
+    }
+
+    // The n most frequent entries, in descending frequency order.
+    std::vector<std::pair<Key, std::size_t>> best(std::size_t n) const
+    {
+        std::vector<Entry const *> entries;
+        entries.reserve(_heap.size());
+        for (auto const &entry : _heap)
+        {
+            entries.push_back(&entry);
+        }
+
+        n = std::min(n, entries.size());
+        std::partial_sort(entries.begin(), entries.begin() + n, entries.end(),
+                          [](Entry const *lhs, Entry const *rhs) {
+                              return lhs->count > rhs->count;
+                          });
+
+        std::vector<std::pair<Key, std::size_t>> ret;
+        ret.reserve(n);
+        for (std::size_t i(0); i < n; ++i)
+        {
+            ret.emplace_back(entries[i]->key, entries[i]->count);
+        }
+
+        return ret;
+    }
+
+  private:
+    void place(std::size_t pos, Entry &&entry)
+    {
+        _heap[pos] = std::move(entry);
+        _position[_heap[pos].key] = pos;
+    }
+
+    void siftUp(std::size_t pos)
+    {
+        Entry entry{std::move(_heap[pos])};
+        while (pos > 0)
+        {
+            auto parent = (pos - 1) / 2;
+            if (_heap[parent].count <= entry.count)
+            {
+                break;
+            }
+            place(pos, std::move(_heap[parent]));
+            pos = parent;
+        }
+        place(pos, std::move(entry));
+    }
+
+    void siftDown(std::size_t pos)
+    {
+        Entry entry{std::move(_heap[pos])};
+        while (true)
+        {
+            auto child = 2 * pos + 1;
+            if (child >= _heap.size())
+            {
+                break;
+            }
+            if (child + 1 < _heap.size() &&
+                _heap[child + 1].count < _heap[child].count)
+            {
+                ++child;
+            }
+            if (entry.count <= _heap[child].count)
+            {
+                break;
+            }
+            place(pos, std::move(_heap[child]));
+            pos = child;
+        }
+        place(pos, std::move(entry));
+    }
+};
+
+/**
+ * @brief Counting state of a top-k stage. In exact mode every key is counted
+ * and a heap of the k most frequent keys is maintained. In approximate mode
+ * the Space-Saving algorithm monitors a bounded number of counters.
+ */
+template <class Key, class Hash, class Eq> class TopKState
+{
+    using heap_t = IndexedMinHeap<Key, Hash, Eq>;
+
+    std::size_t _k;
+    std::size_t _capacity; // Zero in exact mode.
+    std::unordered_map<Key, std::size_t, Hash, Eq> _counts;
+    heap_t _heap;
+    mutable std::mutex _mtx;
+
+  public:
+    TopKState(std::size_t k, std::size_t capacity)
+        : _k(k), _capacity(capacity)
+    {
+        if (0 == _k)
+        {
+            throw std::logic_error("A top-k stage needs a positive k");
+        }
+        if (_capacity && _capacity < _k)
+        {
+            throw std::logic_error("Space-Saving capacity smaller than k");
+        }
+    }
+
+    void add(Key const &key)
+    {
+        std::lock_guard lk(_mtx);
+        addImpl(key);
+    }
+
+    template <class R> void addRange(R &&keys)
+    {
+        std::lock_guard lk(_mtx);
+        for (auto const &key : keys)
+        {
+            addImpl(key);
+        }
+    }
+
+    std::vector<std::pair<Key, std::size_t>> get() const
+    {
+        std::lock_guard lk(_mtx);
+        return _heap.best(_k);
+    }
+
+  private:
+    void addImpl(Key const &key)
+    {
+        if (_capacity)
+        {
+            addApproximate(key);
+        }
+        else
+        {
+            addExact(key);
+        }
+    }
+
+    void addExact(Key const &key)
+    {
+        auto [it, isNew] = _counts.try_emplace(key, 0);
+        auto count = ++it->second;
+
+        if (auto pos = _heap.find(key); pos != heap_t::npos)
+        {
+            _heap.increase(pos, 1);
+        }
+        else if (_heap.size() < _k)
+        {
+            _heap.push(key, count, 0);
+        }
+        else if (_heap.top().count < count)
+        {
+            _heap.replaceTop(key, count, 0);
+        }
+    }
+
+    void addApproximate(Key const &key)
+    {
+        if (auto pos = _heap.find(key); pos != heap_t::npos)
+        {
+            _heap.increase(pos, 1);
+        }
+        else if (_heap.size() < _capacity)
+        {
+            _heap.push(key, 1, 0);
+        }
+        else
+        {
+            // Evict the least frequent key, inheriting its count as error.
+            auto minCount = _heap.top().count;
+            _heap.replaceTop(key, minCount + 1, minCount);
+        }
+    }
+};
+
+} // namespace detail
+
+/**
+ * @brief Selects the bounded memory mode of a top-k stage. The Space-Saving
+ * algorithm monitors "capacity" counters; reported counts may overestimate
+ * the true frequency by at most the count of the least monitored key.
+ */
+struct SpaceSaving
+{
+    std::size_t capacity;
+};
+
+/**
+ * @brief A stage tracking the k most frequent keys of its input.
+ *
+ * @details The stage accepts either single keys or ranges of keys, e.g. the
+ * words of a line. Used as a sink, the current top-k list is queried through
+ * the "get" method. Copies share their state, so a handle kept by the user
+ * observes the copy placed in the pipeline. The "emitter" method creates a
+ * filtering stage that periodically outputs the top-k list.
+ *
+ * @tparam Key Type of the counted keys.
+ * @tparam Hash Hash function for keys.
+ * @tparam Eq Equality comparison for keys.
+ */
+template <class Key, class Hash = std::hash<Key>,
+          class Eq = std::equal_to<Key>>
+class TopK
+{
+  public:
+    using result_t = std::vector<std::pair<Key, std::size_t>>;
+
+  private:
+    std::shared_ptr<detail::TopKState<Key, Hash, Eq>> _state;
+
+  public:
+    // Exact mode: every key is counted.
+    explicit TopK(std::size_t k)
+        : _state(std::make_shared<detail::TopKState<Key, Hash, Eq>>(k, 0))
+    {
+    }
+
+    // Approximate mode: memory is bounded by the Space-Saving capacity.
+    TopK(std::size_t k, SpaceSaving approximation)
+        : _state(std::make_shared<detail::TopKState<Key, Hash, Eq>>(
+              k, approximation.capacity))
+    {
+    }
+
+    void operator()(Key const &key)
+    {
+        _state->add(key);
+    }
+
+    template <std::ranges::input_range R>
+        requires(!std::convertible_to<R, Key> &&
+                 std::convertible_to<std::ranges::range_reference_t<R>,
+                                     Key const &>)
+    void operator()(R &&keys)
+    {
+        _state->addRange(std::forward<R>(keys));
+    }
+
+    /**
+     * @brief The k most frequent keys observed so far, along with their
+     * counts, in descending frequency order.
+     */
+    result_t get() const
+    {
+        return _state->get();
+    }
+
+    /**
+     * @brief Create a filtering stage that counts its input and outputs the
+     * current top-k list once every "period" inputs.
+     */
+    auto emitter(std::size_t period) const
+    {
+        return [topK = *this, period = std::max<std::size_t>(1, period),
+                count = std::size_t{0}](auto &&keys) mutable {
+            topK(std::forward<decltype(keys)>(keys));
+
+            Filtered<result_t> ret;
+            if (0 == ++count % period)
+            {
+                ret.data.emplace(topK.get());
+            }
+            return ret;
+        };
+    }
+};
+
+} // namespace yap
@@ -1,10 +1,9 @@
 // © 2022 Nikolaos Athanasiou, github.com/picanumber
 #pragma once
 
-#include "runtime_utilities.h"
-
 #include <functional>
 #include <optional>
+#include <type_traits>
 
 namespace yap
 {
@@ -34,7 +33,9 @@ template <class T> struct Filtered
 
 template <class F> auto Filter(F &&operation)
 {
-    return [op = std::forward<F>(operation)](auto &&...args) mutable {
+    return [op = std::forward<F>(operation)](auto &&...args) mutable
+        requires std::is_invocable_v<std::decay_t<F> &, decltype(args)...>
+    {
         return Filtered(std::invoke(op, std::forward<decltype(args)>(args)...));
     };
 }
@@ -71,7 +72,9 @@ template <class T> struct Hatchable
 
 template <class F> auto OutputHatchable(F &&operation)
 {
-    return [op = std::forward<F>(operation)](auto &&...args) mutable {
+    return [op = std::forward<F>(operation)](auto &&...args) mutable
+        requires std::is_invocable_v<std::decay_t<F> &, decltype(args)...>
+    {
         return Hatchable(
             std::invoke(op, std::forward<decltype(args)>(args)...));
     };
@@ -0,0 +1,115 @@
+#include "test_common.h"
+#include "yap/arena.h"
+#include "yap/pipeline.h"
+#include "yap/tokens.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+auto finite(int count)
+{
+    return [count, val = 0]() mutable {
+        if (val == count)
+        {
+            throw yap::GeneratorExit{};
+        }
+        return val++;
+    };
+}
+
+// Records where the first allocation for every item lands.
+auto firstAllocations(std::vector<void *> &addresses)
+{
+    return [&addresses](int val, yap::StageContext &ctx) {
+        auto *arena = ctx.arena();
+        void *p = arena->allocate(64);
+        addresses.push_back(p);
+        arena->deallocate(p, 64);
+        return val;
+    };
+}
+
+} // namespace
+
+TEST(TestArena, ResetAfterEveryItem)
+{
+    std::vector<void *> addresses;
+    auto pl = yap::Pipeline{} | finite(tcn::kSmallInputSz) |
+              yap::ArenaBacked(firstAllocations(addresses)) | [](int) {};
+    pl.consume();
+
+    ASSERT_EQ(tcn::kSmallInputSz, addresses.size());
+    for (auto *p : addresses)
+    {
+        EXPECT_EQ(addresses.front(), p);
+    }
+}
+
+TEST(TestArena, ResetAfterBatches)
+{
+    std::vector<void *> addresses;
+    auto pl = yap::Pipeline{yap::WorkStealing{2}} |
+              finite(tcn::kSmallInputSz) |
+              yap::ArenaBacked(firstAllocations(addresses),
+                               yap::ArenaOptions{1024, 4}) |
+              [](int) {};
+    pl.consume();
+
+    // Allocations bump through the arena until it's reset every 4 items.
+    ASSERT_EQ(tcn::kSmallInputSz, addresses.size());
+    for (std::size_t i(0); i < addresses.size(); ++i)
+    {
+        EXPECT_EQ(addresses[i % 4], addresses[i]);
+    }
+    EXPECT_NE(addresses[0], addresses[1]);
+}
+
+TEST(TestArena, DefaultResourceWithoutArena)
+{
+    std::atomic_bool fromDefault{true};
+    auto check = [&fromDefault](int val, yap::StageContext &ctx) {
+        fromDefault = fromDefault &&
+                      ctx.arena() == std::pmr::get_default_resource();
+        return val;
+    };
+
+    auto pl = yap::Pipeline{} | finite(tcn::kSmallInputSz) | check |
+              [](int) {};
+    pl.consume(yap::Synchronous{});
+    EXPECT_TRUE(fromDefault);
+}
+
+TEST(TestArena, StatelessTokensGetArenasOfTheirOwn)
+{
+    auto spell = [](int val, yap::StageContext &ctx) {
+        std::pmr::vector<std::pmr::string> words(ctx.arena());
+        for (int i(0); i < val % 16; ++i)
+        {
+            words.emplace_back("a word long enough to skip small buffers");
+        }
+        return words.size();
+    };
+
+    using wrapped_t = decltype(yap::ArenaBacked(yap::Stateless(spell)));
+    static_assert(yap::detail::stateless_op<wrapped_t>);
+
+    std::atomic_size_t total{0};
+    auto pl = yap::Pipeline{yap::Tokens{4}} | finite(tcn::kMidInputSz) |
+              yap::ArenaBacked(yap::Stateless(spell)) |
+              [&total](std::size_t n) { total += n; };
+    pl.consume();
+
+    std::size_t expected = 0;
+    for (std::size_t i(0); i < tcn::kMidInputSz; ++i)
+    {
+        expected += i % 16;
+    }
+    EXPECT_EQ(expected, total.load());
+}
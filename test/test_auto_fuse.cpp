@@ -0,0 +1,191 @@
+#include "test_common.h"
+#include "yap/auto_fuse.h"
+#include "yap/buffer_queue.h"
+#include "yap/pipeline.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+struct RecordingConsumer : yap::detail::InlineConsumer<int>
+{
+    std::vector<int> items;
+    std::thread::id thread;
+
+    bool consumeInline(int item) override
+    {
+        thread = std::this_thread::get_id();
+        items.push_back(item);
+        return item >= 0; // A negative item marks the end of the stream.
+    }
+};
+
+// Simulate a window where stage 0 pushes and stage 1 pops at the given cost
+// per item, while each stage works for the given service time per item.
+void feedWindow(yap::detail::FusionController &fc, std::uint64_t service,
+                std::uint64_t handoff, std::size_t window)
+{
+    auto &up = *fc.profile(0);
+    auto &down = *fc.profile(1);
+
+    up.items += window;
+    up.busyNs += window * (service + handoff);
+    up.pushes += window;
+    up.pushNs += window * handoff;
+
+    down.items += window;
+    down.busyNs += window * service;
+    down.pops += window;
+    down.popNs += window * handoff;
+
+    for (std::size_t i(0); i < window; ++i)
+    {
+        fc.tick();
+    }
+}
+
+} // namespace
+
+TEST(TestAutoFuse, InlineHandoffToParkedConsumer)
+{
+    yap::BufferQueue<int> buffer;
+    RecordingConsumer consumer;
+    buffer.attach(&consumer);
+    buffer.handoff(true);
+
+    std::atomic_bool released{false};
+    std::thread parked([&] {
+        try
+        {
+            while (true)
+            {
+                buffer.pop(); // Items pushed before parking are popped.
+            }
+        }
+        catch (yap::detail::ClosedError &)
+        {
+            released = true;
+        }
+    });
+
+    // Items are queued while the consumer is not parked in pop.
+    while (!buffer.push(1))
+    {
+        std::this_thread::sleep_for(1ms);
+    }
+
+    EXPECT_EQ(consumer.items, std::vector<int>{1});
+    EXPECT_EQ(consumer.thread, std::this_thread::get_id());
+    EXPECT_FALSE(released);
+
+    // The end of the stream releases the parked consumer.
+    EXPECT_TRUE(buffer.push(-1));
+    parked.join();
+    EXPECT_TRUE(released);
+}
+
+TEST(TestAutoFuse, FuseWhenHandoffDominates)
+{
+    std::vector<std::string> decisions;
+    std::vector<int> links;
+
+    yap::AutoFuse config;
+    config.window = 16;
+    config.log = [&decisions](std::string const &m) {
+        decisions.push_back(m);
+    };
+
+    yap::detail::FusionController fc(config);
+    fc.bind(2, {[&links](bool on) { links.push_back(on); }});
+
+    // Warm-up: handoff is negligible compared to the work.
+    feedWindow(fc, 10'000, 100, config.window);
+    EXPECT_TRUE(links.empty());
+
+    // Handoff dominates, the stages are fused.
+    feedWindow(fc, 100, 1'000, config.window);
+    ASSERT_EQ(links, std::vector<int>{1});
+
+    // Work grows, the stages are split again.
+    feedWindow(fc, 50'000, 1'000, config.window);
+    ASSERT_EQ(links, (std::vector<int>{1, 0}));
+
+    ASSERT_EQ(decisions.size(), 2u);
+    EXPECT_EQ(decisions[0].rfind("fusing stages 0 and 1", 0), 0u);
+    EXPECT_EQ(decisions[1].rfind("splitting stages 0 and 1", 0), 0u);
+}
+
+TEST(TestAutoFuse, NeverCreateBottleneck)
+{
+    std::vector<int> links;
+
+    yap::AutoFuse config;
+    config.window = 8;
+    config.log = nullptr;
+
+    yap::detail::FusionController fc(config);
+    fc.bind(2, {[&links](bool on) { links.push_back(on); }});
+
+    // Although the handoff is a large fraction of the work, two equally
+    // loaded stages would be slower fused than overlapped.
+    feedWindow(fc, 1'000, 600, config.window);
+    EXPECT_TRUE(links.empty());
+}
+
+TEST(TestAutoFuse, SelfTuningPipeline)
+{
+    std::vector<int> result, expected(tcn::kMidInputSz);
+    std::iota(expected.begin(), expected.end(), 1);
+
+    yap::AutoFuse config;
+    config.window = 64;
+    config.log = nullptr;
+
+    auto pl = yap::Pipeline{config} |
+              yap::Consume(expected.begin(), expected.end()) |
+              [](int val) { return val + 1; } |
+              [](int val) { return val - 1; } |
+              [&result](int val) { result.push_back(val); };
+
+    pl.consume();
+
+    EXPECT_EQ(result, expected);
+}
+
+TEST(TestAutoFuse, PauseResume)
+{
+    std::atomic_size_t counter{0};
+
+    yap::AutoFuse config;
+    config.window = 32;
+    config.log = nullptr;
+
+    auto pl = yap::make_pipeline(
+        config, tcn::Iota(1u), [](unsigned val) { return val * 2; },
+        [&counter](unsigned) { ++counter; });
+    pl->run();
+
+    while (counter < tcn::kSmallInputSz)
+    {
+        // Allow some data to flow.
+    }
+    pl->pause();
+
+    auto valueOnPause = counter.load();
+    std::this_thread::sleep_for(1ms);
+    EXPECT_EQ(counter.load(), valueOnPause);
+
+    pl->run();
+    while (counter < valueOnPause + tcn::kSmallInputSz)
+    {
+        // Allow some data to flow.
+    }
+    EXPECT_EQ(yap::ReturnValue::Ok, pl->stop());
+}
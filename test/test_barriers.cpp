@@ -0,0 +1,195 @@
+#include "test_common.h"
+#include "yap/fuse.h"
+#include "yap/pipeline.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <future>
+#include <memory>
+#include <vector>
+
+namespace
+{
+
+struct Tally
+{
+    std::atomic_int items{0};
+    std::atomic_int barriers{0};
+    std::atomic_int itemsAtBarrier{-1};
+};
+
+// Transform that records how many items went through it when the barrier
+// passed.
+struct Counted
+{
+    std::shared_ptr<Tally> tally;
+
+    int operator()(int val)
+    {
+        ++tally->items;
+        return val;
+    }
+
+    void on_barrier()
+    {
+        tally->itemsAtBarrier = tally->items.load();
+        ++tally->barriers;
+    }
+};
+
+struct CountedSink
+{
+    std::shared_ptr<Tally> tally;
+
+    void operator()(int)
+    {
+        ++tally->items;
+    }
+
+    void on_barrier()
+    {
+        tally->itemsAtBarrier = tally->items.load();
+        ++tally->barriers;
+    }
+};
+
+bool passed(std::future<void> &flushed)
+{
+    return std::future_status::ready == flushed.wait_for(5s);
+}
+
+} // namespace
+
+TEST(TestBarriers, FlushFollowsPushedItems)
+{
+    auto mid = std::make_shared<Tally>();
+    auto end = std::make_shared<Tally>();
+    auto pl = yap::Pipeline{yap::Ingress<int>{}} | Counted{mid} |
+              CountedSink{end};
+    pl.run();
+
+    for (int i(0); i < 10; ++i)
+    {
+        pl.push(i);
+    }
+    auto flushed = pl.flush();
+    for (int i(0); i < 10; ++i)
+    {
+        pl.push(i);
+    }
+
+    ASSERT_TRUE(passed(flushed));
+    EXPECT_NO_THROW(flushed.get());
+    EXPECT_EQ(10, mid->itemsAtBarrier.load());
+    EXPECT_EQ(10, end->itemsAtBarrier.load());
+
+    EXPECT_EQ(yap::ReturnValue::Ok, pl.consume());
+    EXPECT_EQ(20, end->items.load());
+    EXPECT_EQ(1, end->barriers.load());
+}
+
+TEST(TestBarriers, PipelineKeepsRunning)
+{
+    auto mid = std::make_shared<Tally>();
+    auto end = std::make_shared<Tally>();
+    auto pl = yap::Pipeline{} | tcn::Iota<int>(0) | Counted{mid} |
+              CountedSink{end};
+    pl.run();
+
+    for (int i(0); i < 3; ++i)
+    {
+        auto flushed = pl.flush();
+        ASSERT_TRUE(passed(flushed));
+    }
+    EXPECT_EQ(3, mid->barriers.load());
+    EXPECT_EQ(3, end->barriers.load());
+    EXPECT_LE(mid->itemsAtBarrier.load(), mid->items.load());
+
+    EXPECT_EQ(yap::ReturnValue::Ok, pl.stop());
+}
+
+TEST(TestBarriers, TokensCarryBarriers)
+{
+    auto mid = std::make_shared<Tally>();
+    auto end = std::make_shared<Tally>();
+    auto pl = yap::Pipeline{yap::Tokens{4}} | tcn::Iota<int>(0) |
+              Counted{mid} | CountedSink{end};
+    pl.run();
+
+    auto flushed = pl.flush();
+    ASSERT_TRUE(passed(flushed));
+    EXPECT_EQ(1, mid->barriers.load());
+    EXPECT_EQ(1, end->barriers.load());
+
+    EXPECT_EQ(yap::ReturnValue::Ok, pl.stop());
+}
+
+TEST(TestBarriers, WorkStealing)
+{
+    auto end = std::make_shared<Tally>();
+    auto pl = yap::Pipeline{yap::WorkStealing{2}} | tcn::Iota<int>(0) |
+              [](int val) { return val + 1; } | CountedSink{end};
+    pl.run();
+
+    auto flushed = pl.flush();
+    ASSERT_TRUE(passed(flushed));
+    EXPECT_EQ(1, end->barriers.load());
+
+    EXPECT_EQ(yap::ReturnValue::Ok, pl.stop());
+}
+
+TEST(TestBarriers, StoppingBreaksTheFlush)
+{
+    auto end = std::make_shared<Tally>();
+    auto pl = yap::Pipeline{yap::Ingress<int>{}} | CountedSink{end};
+    pl.run();
+    pl.pause();
+
+    // Paused stages don't pass the barrier on.
+    auto flushed = pl.flush();
+    EXPECT_EQ(std::future_status::timeout, flushed.wait_for(1ms));
+
+    pl.stop(); // Clears the buffered barrier.
+    EXPECT_THROW(flushed.get(), std::future_error);
+    EXPECT_EQ(0, end->barriers.load());
+}
+
+TEST(TestBarriers, ResultsPassBarriers)
+{
+    auto pl = yap::Pipeline{} | tcn::Iota<int>(0) |
+              [](int val) { return 2 * val; };
+    auto results = pl.results();
+    auto flushed = pl.flush();
+
+    // The barrier passes once pulled, without showing up in the range.
+    int expected = 0;
+    for (auto it = results.begin();
+         std::future_status::ready != flushed.wait_for(0s); ++it)
+    {
+        ASSERT_EQ(expected, *it);
+        expected += 2;
+    }
+    EXPECT_NO_THROW(flushed.get());
+
+    EXPECT_EQ(yap::ReturnValue::Ok, pl.stop());
+}
+
+TEST(TestBarriers, FuseForwardsTheHook)
+{
+    auto first = std::make_shared<Tally>();
+    auto second = std::make_shared<Tally>();
+    auto end = std::make_shared<Tally>();
+    auto pl = yap::Pipeline{yap::Ingress<int>{}} |
+              yap::Fuse(Counted{first}, Counted{second}) | CountedSink{end};
+    pl.run();
+
+    pl.push(1);
+    auto flushed = pl.flush();
+    ASSERT_TRUE(passed(flushed));
+    EXPECT_EQ(1, first->itemsAtBarrier.load());
+    EXPECT_EQ(1, second->itemsAtBarrier.load());
+    EXPECT_EQ(1, end->itemsAtBarrier.load());
+
+    EXPECT_EQ(yap::ReturnValue::Ok, pl.consume());
+}
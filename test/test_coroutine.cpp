@@ -0,0 +1,148 @@
+#include "test_common.h"
+#include "yap/coroutine.h"
+#include "yap/executor.h"
+#include "yap/pipeline.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <numeric>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+auto boundedIota(int last)
+{
+    return [eng = tcn::Iota(1), last]() mutable {
+        int ret = eng();
+        if (ret > last)
+        {
+            throw yap::GeneratorExit{};
+        }
+        return ret;
+    };
+}
+
+auto sleepy(std::chrono::milliseconds duration)
+{
+    return [duration](int val) -> yap::Task<int> {
+        co_await yap::sleep_for(duration);
+        co_return val;
+    };
+}
+
+yap::Task<int> twice(int val)
+{
+    co_await yap::sleep_for(100us);
+    co_return 2 * val;
+}
+
+} // namespace
+
+TEST(TestCoroutine, StageOnDedicatedThread)
+{
+    std::vector<int> result, expected(tcn::kSmallInputSz);
+    std::iota(expected.begin(), expected.end(), 1);
+
+    auto pl = yap::Pipeline{} |
+              boundedIota(static_cast<int>(tcn::kSmallInputSz)) |
+              sleepy(0ms) | [](int val) -> yap::Task<int> {
+        co_return co_await twice(val) / 2;
+    } | [&result](int val) { result.push_back(val); };
+    pl.consume();
+
+    EXPECT_EQ(result, expected);
+}
+
+TEST(TestCoroutine, SuspendedStagesYieldTheirThread)
+{
+    constexpr int kItems = 50;
+    std::vector<int> result, expected(kItems);
+    std::iota(expected.begin(), expected.end(), 1);
+
+    // Blocking for every sleep would take 4 * kItems * 2ms on one thread.
+    auto start = std::chrono::steady_clock::now();
+    auto pl = yap::Pipeline{yap::WorkStealing{1}} | boundedIota(kItems) |
+              sleepy(2ms) | sleepy(2ms) | sleepy(2ms) | sleepy(2ms) |
+              [&result](int val) { result.push_back(val); };
+    pl.consume();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    EXPECT_EQ(result, expected);
+    EXPECT_LT(elapsed, 3 * kItems * 2ms);
+}
+
+TEST(TestCoroutine, AwaitAsyncOperations)
+{
+    std::vector<int> result;
+    std::vector<std::thread> io;
+
+    // Operations completed from another thread.
+    auto remote = [&io](int val) -> yap::Task<int> {
+        auto ret = co_await yap::Async<int>([&io, val](auto done) {
+            io.emplace_back([done, val] { done(val + 1); });
+        });
+        co_await yap::Async<>([](auto done) { done(); });
+        co_return co_await twice(ret);
+    };
+
+    yap::Executor executor(2);
+    auto pl = yap::Pipeline{executor} | boundedIota(5) | remote |
+              [&result](int val) { result.push_back(val); };
+    pl.consume();
+
+    for (auto &t : io)
+    {
+        t.join();
+    }
+    EXPECT_EQ(result, (std::vector<int>{4, 6, 8, 10, 12}));
+}
+
+TEST(TestCoroutine, GeneratorFilterAndSink)
+{
+    std::vector<int> result;
+
+    auto pl =
+        yap::Pipeline{yap::WorkStealing{2}} |
+        [i = 0]() mutable -> yap::Task<int> {
+            co_await yap::sleep_for(100us);
+            if (++i > 10)
+            {
+                throw yap::GeneratorExit{};
+            }
+            co_return i;
+        } |
+        [](int val) -> yap::Task<yap::Filtered<int>> {
+            co_await yap::sleep_for(100us);
+            co_return yap::Filtered<int>(
+                val % 2 ? std::optional<int>(val) : std::nullopt);
+        } |
+        [&result](yap::Filtered<int> val) -> yap::Task<> {
+            co_await yap::sleep_for(100us);
+            result.push_back(*val.data);
+        };
+    pl.consume();
+
+    EXPECT_EQ(result, (std::vector<int>{1, 3, 5, 7, 9}));
+}
+
+TEST(TestCoroutine, ExceptionsDropTheItem)
+{
+    std::vector<int> result;
+
+    auto pl = yap::Pipeline{yap::WorkStealing{2}} | boundedIota(6) |
+              [](int val) -> yap::Task<int> {
+        co_await yap::sleep_for(100us);
+        if (val % 3 == 0)
+        {
+            throw std::runtime_error("drop");
+        }
+        co_return val;
+    } | [&result](int val) { result.push_back(val); };
+    pl.consume();
+
+    EXPECT_EQ(result, (std::vector<int>{1, 2, 4, 5}));
+}
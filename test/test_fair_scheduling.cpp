@@ -0,0 +1,102 @@
+#include "test_common.h"
+#include "yap/executor.h"
+#include "yap/pipeline.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+// Occupy the calling thread for the given time.
+auto busy(std::chrono::microseconds duration)
+{
+    return [duration](int val) {
+        auto until = std::chrono::steady_clock::now() + duration;
+        while (std::chrono::steady_clock::now() < until)
+        {
+        }
+        return val;
+    };
+}
+
+auto boundedIota(int last)
+{
+    return [eng = tcn::Iota(1), last]() mutable {
+        int ret = eng();
+        if (ret > last)
+        {
+            throw yap::GeneratorExit{};
+        }
+        return ret;
+    };
+}
+
+} // namespace
+
+TEST(TestFairScheduling, SharesFollowWeights)
+{
+    yap::Executor executor(1);
+    std::atomic_int light{0}, heavy{0};
+
+    auto pl1 = yap::Pipeline{executor} | tcn::Iota(1) | busy(20us) |
+               [&light](int) { ++light; };
+    auto pl3 = yap::Pipeline{executor.weighted(3)} | tcn::Iota(1) |
+               busy(20us) | [&heavy](int) { ++heavy; };
+    EXPECT_EQ(executor.weighted(3).weight(), 3u);
+
+    pl1.run();
+    pl3.run();
+    std::this_thread::sleep_for(300ms);
+    pl1.stop();
+    pl3.stop();
+
+    ASSERT_GT(pl1.cpuTime().count(), 0);
+    double share = static_cast<double>(pl3.cpuTime().count()) /
+                   static_cast<double>(pl1.cpuTime().count());
+    EXPECT_GT(share, 2.0);
+    EXPECT_LT(share, 4.5);
+    EXPECT_GT(heavy.load(), 2 * light.load());
+}
+
+TEST(TestFairScheduling, HeavyPipelineDoesNotStarveOthers)
+{
+    yap::Executor executor(1);
+
+    auto heavy = yap::Pipeline{executor.weighted(8)} | tcn::Iota(1) |
+                 busy(50us) | [](int) {};
+    heavy.run();
+
+    std::vector<int> result, expected(tcn::kSmallInputSz);
+    std::iota(expected.begin(), expected.end(), 1);
+
+    auto light = yap::Pipeline{executor} |
+                 boundedIota(static_cast<int>(tcn::kSmallInputSz)) |
+                 busy(10us) | [&result](int val) { result.push_back(val); };
+    EXPECT_EQ(yap::ReturnValue::Ok, light.consume());
+    heavy.stop();
+
+    EXPECT_EQ(result, expected);
+}
+
+TEST(TestFairScheduling, CpuTimeAccounting)
+{
+    yap::Executor executor(2);
+
+    auto pp = yap::make_pipeline(executor, boundedIota(1'000), busy(10us),
+                                 [](int) {});
+    EXPECT_EQ(pp->cpuTime().count(), 0);
+    pp->consume();
+    EXPECT_GE(pp->cpuTime(), 1'000 * 10us / 2);
+
+    // Only pipelines on a shared executor are accounted.
+    auto pl = yap::Pipeline{yap::WorkStealing{2}} | boundedIota(1'000) |
+              busy(1us) | [](int) {};
+    pl.consume();
+    EXPECT_EQ(pl.cpuTime().count(), 0);
+}
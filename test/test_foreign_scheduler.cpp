@@ -0,0 +1,202 @@
+#include "test_common.h"
+#include "yap/coroutine.h"
+#include "yap/pipeline.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+// Minimal thread pool standing in for the scheduler of another library.
+class ForeignPool
+{
+    std::vector<std::thread> _threads;
+    std::deque<std::function<void()>> _tasks;
+    std::mutex _mtx;
+    std::condition_variable _bell;
+    bool _closing{false};
+
+  public:
+    explicit ForeignPool(std::size_t threads)
+    {
+        for (std::size_t i(0); i < threads; ++i)
+        {
+            _threads.emplace_back([this] { work(); });
+        }
+    }
+
+    ~ForeignPool()
+    {
+        {
+            std::lock_guard lk(_mtx);
+            _closing = true;
+        }
+        _bell.notify_all();
+        for (auto &t : _threads)
+        {
+            t.join();
+        }
+    }
+
+    void submit(std::function<void()> task)
+    {
+        {
+            std::lock_guard lk(_mtx);
+            _tasks.push_back(std::move(task));
+        }
+        _bell.notify_one();
+    }
+
+    bool owns(std::thread::id id) const
+    {
+        for (auto &t : _threads)
+        {
+            if (t.get_id() == id)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    yap::Executor executor()
+    {
+        return yap::Executor(
+            [this](std::function<void()> task) { submit(std::move(task)); });
+    }
+
+  private:
+    void work()
+    {
+        std::unique_lock lk(_mtx);
+        while (true)
+        {
+            _bell.wait(lk, [this] { return _closing || !_tasks.empty(); });
+            if (_tasks.empty())
+            {
+                return;
+            }
+            auto task = std::move(_tasks.front());
+            _tasks.pop_front();
+            lk.unlock();
+            task();
+            lk.lock();
+        }
+    }
+};
+
+auto finite(int count)
+{
+    return [count, val = 0]() mutable {
+        if (val == count)
+        {
+            throw yap::GeneratorExit{};
+        }
+        return val++;
+    };
+}
+
+} // namespace
+
+TEST(TestForeignScheduler, StagesRunOnTheForeignPool)
+{
+    ForeignPool foreign(2);
+    auto executor = foreign.executor();
+    EXPECT_EQ(0u, executor.size());
+
+    std::mutex mtx;
+    std::set<std::thread::id> threads;
+    std::size_t sum = 0;
+    auto pl = yap::Pipeline{executor} | finite(tcn::kMidInputSz) |
+              [](int val) { return 2 * val; } |
+              [&](int val) {
+                  std::lock_guard lk(mtx);
+                  threads.insert(std::this_thread::get_id());
+                  sum += val;
+              };
+
+    EXPECT_EQ(yap::ReturnValue::Ok, pl.consume());
+    EXPECT_EQ(tcn::kMidInputSz * (tcn::kMidInputSz - 1), sum);
+    for (auto id : threads)
+    {
+        EXPECT_TRUE(foreign.owns(id));
+    }
+}
+
+TEST(TestForeignScheduler, ConsumeThenDoesNotBlock)
+{
+    ForeignPool foreign(1);
+    std::atomic_size_t count{0};
+    auto pl = yap::Pipeline{foreign.executor()} | finite(tcn::kMidInputSz) |
+              [&count](int) { ++count; };
+
+    std::promise<std::pair<yap::ReturnValue, bool>> result;
+    pl.consumeThen([&](yap::ReturnValue ret) {
+        result.set_value({ret, foreign.owns(std::this_thread::get_id())});
+    });
+
+    auto [ret, onForeignThread] = result.get_future().get();
+    EXPECT_EQ(yap::ReturnValue::Ok, ret);
+    EXPECT_TRUE(onForeignThread);
+    EXPECT_EQ(tcn::kMidInputSz, count.load());
+
+    // The pipeline is idle again and can consume another stream.
+    EXPECT_EQ(yap::ReturnValue::NoOp, pl.stop());
+}
+
+TEST(TestForeignScheduler, ConsumeAsyncAwaits)
+{
+    auto consumeTwice = [](yap::pipeline &pl) -> yap::Task<int> {
+        int ok = 0;
+        ok += yap::ReturnValue::Ok == co_await pl.consumeAsync();
+        ok += yap::ReturnValue::Ok == co_await pl.consumeAsync();
+        co_return ok;
+    };
+
+    ForeignPool foreign(2);
+    std::atomic_size_t count{0};
+    auto pl = yap::Pipeline{foreign.executor()} |
+              [val = 0]() mutable {
+                  if (++val % tcn::kSmallInputSz == 0)
+                  {
+                      throw yap::GeneratorExit{};
+                  }
+                  return val;
+              } |
+              [&count](int) { ++count; };
+
+    auto task = consumeTwice(pl);
+    EXPECT_EQ(2, yap::detail::wait(task));
+    EXPECT_EQ(2 * (tcn::kSmallInputSz - 1), count.load());
+}
+
+TEST(TestForeignScheduler, StopCompletesPendingConsumption)
+{
+    ForeignPool foreign(2);
+    auto pl = yap::Pipeline{foreign.executor()} | tcn::Iota(0) | [](int) {};
+
+    std::promise<yap::ReturnValue> result;
+    pl.consumeThen([&](yap::ReturnValue ret) { result.set_value(ret); });
+    std::this_thread::sleep_for(1ms);
+    EXPECT_EQ(yap::ReturnValue::Ok, pl.stop());
+    EXPECT_EQ(yap::ReturnValue::NoOp, result.get_future().get());
+}
+
+TEST(TestForeignScheduler, ConsumeThenWithOwnThreads)
+{
+    auto pl = yap::Pipeline{} | finite(tcn::kSmallInputSz) | [](int) {};
+
+    std::promise<yap::ReturnValue> result;
+    pl.consumeThen([&](yap::ReturnValue ret) { result.set_value(ret); });
+    EXPECT_EQ(yap::ReturnValue::Ok, result.get_future().get());
+}
@@ -0,0 +1,125 @@
+#include "test_common.h"
+#include "yap/executor.h"
+#include "yap/fuse.h"
+#include "yap/pipeline.h"
+#include "yap/topology.h"
+
+#include <gtest/gtest.h>
+
+#include <numeric>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+const auto increment = [](int val) { return val + 1; };
+const auto twice = [](int val) { return 2 * val; };
+const auto keepOdd = yap::Filter(
+    [](int val) { return val % 2 ? std::optional<int>(val) : std::nullopt; });
+
+} // namespace
+
+TEST(TestFuse, ChainAppliesInOrder)
+{
+    std::vector<int> source(tcn::kSmallInputSz), result;
+    std::iota(source.begin(), source.end(), 0);
+
+    auto pl = yap::Pipeline{} | yap::Consume(source.begin(), source.end()) |
+              yap::Fuse(increment, twice, [](int val) {
+                  return std::to_string(val);
+              }) |
+              [&result](std::string const &s) {
+                  result.push_back(std::stoi(s));
+              };
+    pl.consume();
+
+    ASSERT_EQ(result.size(), source.size());
+    for (std::size_t i(0); i < source.size(); ++i)
+    {
+        EXPECT_EQ(result[i], 2 * (source[i] + 1));
+    }
+}
+
+TEST(TestFuse, FilterWithinChain)
+{
+    std::vector<int> source{1, 2, 3, 4, 5, 6}, result;
+
+    auto fused = yap::Fuse(keepOdd) |
+                 [](yap::Filtered<int> val) { return *val.data * 10; };
+
+    auto pl = yap::Pipeline{} | yap::Consume(source.begin(), source.end()) |
+              fused | [&result](int val) { result.push_back(val); };
+    pl.consume();
+
+    EXPECT_EQ(result, (std::vector<int>{10, 30, 50}));
+}
+
+TEST(TestFuse, HatchWithinChain)
+{
+    std::vector<int> source{1, 2, 3}, result;
+
+    // Output N copies of each number N, then increment them.
+    auto pl =
+        yap::Pipeline{} | yap::Consume(source.begin(), source.end()) |
+        yap::Fuse([](int val) { return yap::Hatchable<int>(val); },
+                  [cur = 0, count = 0](yap::Hatchable<int> val) mutable {
+                      if (val)
+                      {
+                          cur = count = *val.data;
+                      }
+                      return count-- > 0 ? std::optional<int>(cur)
+                                         : std::nullopt;
+                  },
+                  [](std::optional<int> val) { return *val + 1; }) |
+        [&result](int val) { result.push_back(val); };
+    pl.consume();
+
+    EXPECT_EQ(result, (std::vector<int>{2, 3, 3, 4, 4, 4}));
+}
+
+TEST(TestFuse, GeneratorAndSinkFuse)
+{
+    std::vector<int> source(tcn::kMidInputSz), result;
+    std::iota(source.begin(), source.end(), 0);
+
+    auto pl =
+        yap::Pipeline{} |
+        yap::Fuse(yap::Consume(source.begin(), source.end()), increment) |
+        yap::Fuse(twice, [&result](int val) { result.push_back(val); });
+    pl.consume();
+
+    ASSERT_EQ(result.size(), source.size());
+    EXPECT_EQ(result.back(), 2 * static_cast<int>(tcn::kMidInputSz));
+}
+
+TEST(TestFuse, FilteringGenerator)
+{
+    std::vector<int> source{1, 2, 3, 4, 5}, result;
+
+    auto pl = yap::Pipeline{} |
+              yap::Fuse(yap::Consume(source.begin(), source.end()), keepOdd) |
+              [&result](yap::Filtered<int> val) {
+                  result.push_back(*val.data);
+              };
+    pl.consume();
+
+    EXPECT_EQ(result, (std::vector<int>{1, 3, 5}));
+}
+
+TEST(TestFuse, ExecutorMode)
+{
+    std::vector<int> source(tcn::kMidInputSz), result;
+    std::iota(source.begin(), source.end(), 0);
+
+    auto pl = yap::Pipeline{yap::WorkStealing{2}} |
+              yap::Consume(source.begin(), source.end()) |
+              yap::Fuse(increment, keepOdd) |
+              [&result](yap::Filtered<int> val) {
+                  result.push_back(*val.data);
+              };
+    pl.consume();
+
+    EXPECT_EQ(result.size(), tcn::kMidInputSz / 2);
+}
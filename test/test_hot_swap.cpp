@@ -0,0 +1,177 @@
+#include "test_common.h"
+#include "yap/pipeline.h"
+#include "yap/tokens.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+using tagged_t = std::pair<int, int>; // Value and version of the operation.
+
+struct Recorder
+{
+    std::mutex mtx;
+    std::vector<tagged_t> seen;
+
+    void operator()(tagged_t val)
+    {
+        std::lock_guard lk(mtx);
+        seen.push_back(val);
+    }
+
+    std::size_t size()
+    {
+        std::lock_guard lk(mtx);
+        return seen.size();
+    }
+
+    bool sawVersion(int version)
+    {
+        std::lock_guard lk(mtx);
+        return !seen.empty() && version == seen.back().second;
+    }
+};
+
+auto versioned(int version)
+{
+    return [version](int val) { return tagged_t{val, version}; };
+}
+
+// Items are processed in order, none is lost unless the pipeline was paused,
+// and no item is processed by the old operation after the new one took over.
+void expectCleanSwitch(std::vector<tagged_t> const &seen, bool paused = false)
+{
+    ASSERT_FALSE(seen.empty());
+    EXPECT_EQ(2, seen.back().second);
+    for (std::size_t i(1); i < seen.size(); ++i)
+    {
+        if (paused)
+        {
+            ASSERT_LT(seen[i - 1].first, seen[i].first);
+        }
+        else
+        {
+            ASSERT_EQ(seen[i - 1].first + 1, seen[i].first);
+        }
+        ASSERT_LE(seen[i - 1].second, seen[i].second);
+    }
+}
+
+template <class P> void switchWhileRunning(P &pl, Recorder &rec)
+{
+    pl.run();
+    while (rec.size() < tcn::kSmallInputSz)
+    {
+        std::this_thread::sleep_for(1ms);
+    }
+
+    pl.template replace<1>(versioned(2));
+    while (!rec.sawVersion(2))
+    {
+        std::this_thread::sleep_for(1ms);
+    }
+    pl.stop();
+}
+
+} // namespace
+
+TEST(TestHotSwap, SwitchesWhileRunning)
+{
+    Recorder rec;
+    auto pl = yap::Pipeline{} | tcn::Iota(0) | versioned(1) |
+              [&rec](tagged_t val) { rec(val); };
+
+    switchWhileRunning(pl, rec);
+    expectCleanSwitch(rec.seen);
+}
+
+TEST(TestHotSwap, SwitchesOnExecutor)
+{
+    Recorder rec;
+    auto pl = yap::Pipeline{yap::WorkStealing{2}} | tcn::Iota(0) |
+              versioned(1) | [&rec](tagged_t val) { rec(val); };
+
+    switchWhileRunning(pl, rec);
+    expectCleanSwitch(rec.seen);
+}
+
+TEST(TestHotSwap, SwitchesWithTokens)
+{
+    Recorder rec;
+    auto pl = yap::Pipeline{yap::Tokens{4}} | tcn::Iota(0) | versioned(1) |
+              [&rec](tagged_t val) { rec(val); };
+
+    switchWhileRunning(pl, rec);
+    expectCleanSwitch(rec.seen);
+}
+
+TEST(TestHotSwap, OldOperationDestroyedOffTheWorker)
+{
+    std::atomic<std::thread::id> worker, destroyer;
+    std::shared_ptr<int> guard(new int(1), [&destroyer](int *p) {
+        destroyer = std::this_thread::get_id();
+        delete p;
+    });
+
+    Recorder rec;
+    auto pl = yap::Pipeline{} | tcn::Iota(0) |
+              [&worker, guard = std::move(guard)](int val) {
+                  worker = std::this_thread::get_id();
+                  return tagged_t{val, *guard};
+              } |
+              [&rec](tagged_t val) { rec(val); };
+
+    switchWhileRunning(pl, rec);
+    expectCleanSwitch(rec.seen);
+    EXPECT_EQ(std::this_thread::get_id(), destroyer.load());
+    EXPECT_NE(worker.load(), destroyer.load());
+}
+
+TEST(TestHotSwap, ReplaceWhilePaused)
+{
+    int const total = 10 * tcn::kSmallInputSz;
+    int count = 0;
+    auto gen = [&count, total] {
+        if (count == total)
+        {
+            throw yap::GeneratorExit{};
+        }
+        std::this_thread::sleep_for(10us);
+        return count++;
+    };
+
+    Recorder rec;
+    auto pl = yap::Pipeline{} | gen | versioned(1) |
+              [&rec](tagged_t val) { rec(val); };
+
+    pl.run();
+    while (rec.size() < tcn::kSmallInputSz)
+    {
+        std::this_thread::sleep_for(1ms);
+    }
+    pl.pause();
+    pl.replace<1>(versioned(2));
+    pl.consume();
+
+    // Leftovers of the paused run are processed by the new operation.
+    ASSERT_EQ(total - 1, rec.seen.back().first);
+    expectCleanSwitch(rec.seen, true);
+}
+
+TEST(TestHotSwap, ReplacementKeepsStatelessMarker)
+{
+    auto pl = yap::Pipeline{yap::Tokens{2}} | tcn::Iota(0) |
+              yap::Stateless(versioned(1)) | [](tagged_t) {};
+
+    EXPECT_THROW(pl.replace<1>(versioned(2)), std::invalid_argument);
+    EXPECT_NO_THROW(pl.replace<1>(yap::Stateless(versioned(2))));
+}
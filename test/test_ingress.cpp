@@ -0,0 +1,131 @@
+#include "test_common.h"
+#include "yap/pipeline.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+TEST(TestIngress, PushFromForeignThreads)
+{
+    constexpr int kProducers = 4;
+
+    std::atomic_size_t sum{0}, count{0};
+    auto pl = yap::Pipeline{yap::Ingress<int>{16}} |
+              [](int val) { return 2 * val; } |
+              [&](int val) {
+                  sum += val;
+                  ++count;
+              };
+    EXPECT_EQ(yap::ReturnValue::Ok, pl.run());
+
+    std::vector<std::thread> producers;
+    for (int p(0); p < kProducers; ++p)
+    {
+        producers.emplace_back([&pl] {
+            for (std::size_t i(0); i < tcn::kMidInputSz; ++i)
+            {
+                EXPECT_EQ(yap::ReturnValue::Ok, pl.push(static_cast<int>(i)));
+            }
+        });
+    }
+    for (auto &t : producers)
+    {
+        t.join();
+    }
+
+    // Consuming ends the stream after the items pushed so far.
+    EXPECT_EQ(yap::ReturnValue::Ok, pl.consume());
+    EXPECT_EQ(kProducers * tcn::kMidInputSz, count.load());
+    EXPECT_EQ(kProducers * tcn::kMidInputSz * (tcn::kMidInputSz - 1),
+              sum.load());
+}
+
+TEST(TestIngress, BackpressureLeavesItemsToTheCaller)
+{
+    std::size_t count = 0;
+    auto pl = yap::Pipeline{yap::Ingress<std::unique_ptr<int>>{4}} |
+              [&count](std::unique_ptr<int> ptr) { count += !!ptr; };
+
+    // Items are buffered until the pipeline runs.
+    for (int i(0); i < 4; ++i)
+    {
+        EXPECT_EQ(yap::ReturnValue::Ok,
+                  pl.tryPush(std::make_unique<int>(i)));
+    }
+
+    auto extra = std::make_unique<int>(4);
+    EXPECT_EQ(yap::ReturnValue::NoOp, pl.tryPush(std::move(extra)));
+    EXPECT_EQ(yap::ReturnValue::NoOp, pl.pushFor(std::move(extra), 1ms));
+    ASSERT_TRUE(extra);
+
+    EXPECT_EQ(yap::ReturnValue::Ok, pl.consume());
+    EXPECT_EQ(4u, count);
+
+    EXPECT_EQ(yap::ReturnValue::Ok, pl.pushFor(std::move(extra), 1ms));
+    EXPECT_FALSE(extra);
+}
+
+TEST(TestIngress, PushWaitsForRoom)
+{
+    std::atomic_size_t count{0};
+    auto pl = yap::Pipeline{yap::Ingress<int>{2}} | [&count](int) {
+        std::this_thread::sleep_for(10us);
+        ++count;
+    };
+    pl.run();
+
+    for (std::size_t i(0); i < tcn::kSmallInputSz; ++i)
+    {
+        EXPECT_EQ(yap::ReturnValue::Ok, pl.push(static_cast<int>(i)));
+    }
+    EXPECT_EQ(yap::ReturnValue::Ok, pl.consume());
+    EXPECT_EQ(tcn::kSmallInputSz, count.load());
+}
+
+TEST(TestIngress, SynchronousConsume)
+{
+    std::vector<int> seen;
+    auto pl = yap::Pipeline{yap::Ingress<int>{}} |
+              [&seen](int val) { seen.push_back(val); };
+
+    for (int i(0); i < 3; ++i)
+    {
+        pl.push(i);
+    }
+    EXPECT_EQ(yap::ReturnValue::Ok, pl.consume(yap::Synchronous{}));
+    EXPECT_EQ((std::vector<int>{0, 1, 2}), seen);
+}
+
+TEST(TestIngress, PulledResults)
+{
+    auto pl =
+        yap::Pipeline{yap::Ingress<int>{}} | [](int val) { return 2 * val; };
+
+    auto results = pl.results();
+    std::thread producer([&pl] {
+        for (std::size_t i(0); i < tcn::kSmallInputSz; ++i)
+        {
+            pl.push(static_cast<int>(i));
+        }
+        pl.consume();
+    });
+
+    int expected = 0;
+    for (auto &&val : results)
+    {
+        EXPECT_EQ(expected, val);
+        expected += 2;
+    }
+    producer.join();
+    EXPECT_EQ(2 * tcn::kSmallInputSz, static_cast<std::size_t>(expected));
+}
+
+TEST(TestIngress, OnlyIngressPipelinesAcceptPushes)
+{
+    auto pl = yap::Pipeline{} | tcn::Iota(0) | [](int) {};
+    EXPECT_THROW(pl.push(1), std::logic_error);
+}
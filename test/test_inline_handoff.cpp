@@ -0,0 +1,144 @@
+#include "test_common.h"
+#include "yap/buffer_queue.h"
+#include "yap/pipeline.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <numeric>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+struct CountingConsumer : yap::detail::InlineConsumer<int>
+{
+    std::atomic_int consumed{0};
+
+    bool consumeInline(int) override
+    {
+        ++consumed;
+        return true;
+    }
+};
+
+} // namespace
+
+TEST(TestInlineHandoff, OfferOnlyToParkedConsumer)
+{
+    yap::BufferQueue<int> buffer;
+    CountingConsumer consumer;
+    buffer.attach(&consumer);
+
+    int item = 1;
+    EXPECT_FALSE(buffer.offer(item)); // Nobody waits for input.
+
+    std::atomic_int popped{0};
+    std::thread parked([&] {
+        try
+        {
+            while (true)
+            {
+                buffer.pop();
+                ++popped;
+            }
+        }
+        catch (yap::detail::ClosedError &)
+        {
+        }
+    });
+
+    while (!buffer.offer(item))
+    {
+        std::this_thread::sleep_for(1ms);
+    }
+    EXPECT_EQ(consumer.consumed.load(), 1);
+
+    buffer.set(yap::BufferBehavior::Closed);
+    parked.join();
+    EXPECT_EQ(popped.load(), 0);
+    EXPECT_FALSE(buffer.offer(item));
+}
+
+TEST(TestInlineHandoff, LightLoadRunsInline)
+{
+    constexpr int kItems = 50;
+    std::vector<std::pair<std::thread::id, std::thread::id>> threads;
+
+    auto pl = yap::Pipeline{yap::InlineHandoff{}} |
+              [i = 0]() mutable {
+                  if (i == kItems)
+                  {
+                      throw yap::GeneratorExit{};
+                  }
+                  std::this_thread::sleep_for(1ms); // Sparse input.
+                  return i++;
+              } |
+              [](int) { return std::this_thread::get_id(); } |
+              [&threads](std::thread::id upstream) {
+                  threads.emplace_back(upstream, std::this_thread::get_id());
+              };
+    pl.consume();
+
+    ASSERT_EQ(threads.size(), static_cast<std::size_t>(kItems));
+    auto sameThread = std::count_if(
+        threads.begin(), threads.end(),
+        [](auto const &ids) { return ids.first == ids.second; });
+    EXPECT_GT(sameThread, kItems / 2);
+}
+
+TEST(TestInlineHandoff, OrderUnderLoad)
+{
+    std::vector<int> result, expected(tcn::kMidInputSz);
+    std::iota(expected.begin(), expected.end(), 1);
+
+    auto pl = yap::Pipeline{yap::InlineHandoff{}} |
+              yap::Consume(expected.begin(), expected.end()) |
+              [](int val) { return val + 1; } |
+              [](int val) { return val - 1; } |
+              [&result](int val) { result.push_back(val); };
+    pl.consume();
+
+    EXPECT_EQ(result, expected);
+}
+
+TEST(TestInlineHandoff, PauseResume)
+{
+    unsigned long long counter = 0;
+    std::atomic_ullong atomicCounter = 0;
+    // The plain counter verifies the sink isn't invoked in parallel, whether
+    // inline or on its own thread.
+    auto mockSink = [&counter, &atomicCounter](auto) {
+        ++counter;
+        ++atomicCounter;
+    };
+
+    auto pp = yap::make_pipeline(
+        yap::InlineHandoff{}, tcn::Iota(1u),
+        [](unsigned val) { return val + 1; }, mockSink);
+    pp->run();
+
+    while (atomicCounter < tcn::kSmallInputSz)
+    {
+        // Allow some data to flow.
+    }
+
+    pp->pause();
+
+    auto acValueOnPause = atomicCounter.load();
+    EXPECT_EQ(acValueOnPause, counter);
+    std::this_thread::sleep_for(1ms);
+    EXPECT_EQ(atomicCounter.load(), acValueOnPause);
+
+    pp->run();
+    while (atomicCounter < acValueOnPause + tcn::kSmallInputSz)
+    {
+        // Allow some data to flow.
+    }
+
+    EXPECT_EQ(yap::ReturnValue::Ok, pp->stop());
+    EXPECT_EQ(atomicCounter.load(), counter);
+}
@@ -0,0 +1,89 @@
+#include "test_common.h"
+#include "yap/memoize.h"
+#include "yap/pipeline.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+namespace
+{
+
+struct CountingSquare
+{
+    int *calls;
+
+    int operator()(int val)
+    {
+        ++*calls;
+        return val * val;
+    }
+};
+
+} // namespace
+
+TEST(TestMemoize, RepeatedInputsHitTheCache)
+{
+    int calls = 0;
+    auto square = yap::Memoize<int>(CountingSquare{&calls}, 4);
+
+    EXPECT_EQ(square(3), 9);
+    EXPECT_EQ(square(3), 9);
+    EXPECT_EQ(square(4), 16);
+    EXPECT_EQ(square(3), 9);
+
+    EXPECT_EQ(calls, 2);
+    EXPECT_EQ(square.hits(), 2u);
+    EXPECT_EQ(square.misses(), 2u);
+}
+
+TEST(TestMemoize, LeastRecentlyUsedIsEvicted)
+{
+    int calls = 0;
+    auto square = yap::Memoize<int>(CountingSquare{&calls}, 2);
+
+    square(1);
+    square(2);
+    square(1); // 2 is now the least recently used entry.
+    square(3); // Evicts 2.
+    EXPECT_EQ(calls, 3);
+
+    square(1);
+    EXPECT_EQ(calls, 3);
+    square(2);
+    EXPECT_EQ(calls, 4);
+}
+
+TEST(TestMemoize, ZeroCapacityNeverCaches)
+{
+    int calls = 0;
+    auto square = yap::Memoize<int>(CountingSquare{&calls}, 0);
+
+    square(5);
+    square(5);
+    EXPECT_EQ(calls, 2);
+    EXPECT_EQ(square.hits(), 0u);
+}
+
+TEST(TestMemoize, MemoizedStage)
+{
+    std::vector<std::string> input;
+    for (std::size_t i(0); i < tcn::kMidInputSz; ++i)
+    {
+        input.push_back(std::to_string(i % 10));
+    }
+
+    std::vector<std::size_t> output;
+    auto lengthOf = yap::Memoize<std::string>(
+        [](std::string const &s) { return s.size(); }, 16);
+
+    auto pl = yap::Pipeline{} | yap::Consume(input.begin(), input.end()) |
+              lengthOf |
+              [&output](std::size_t len) { output.push_back(len); };
+    pl.consume();
+
+    EXPECT_EQ(output, std::vector<std::size_t>(input.size(), 1));
+    EXPECT_EQ(lengthOf.misses(), 10u);
+    EXPECT_EQ(lengthOf.hits(), input.size() - 10);
+}
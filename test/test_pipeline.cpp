@@ -4,7 +4,10 @@
 #include <gtest/gtest.h>
 
 #include <atomic>
+#include <mutex>
 #include <numeric>
+#include <set>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -131,6 +134,34 @@ TEST(TestPipeline, PauseResume)
     });
 }
 
+TEST(TestPipeline, PauseResumeKeepsThreads)
+{
+    std::mutex mtx;
+    std::set<std::thread::id> sinkThreads;
+    std::atomic_ullong counter = 0;
+
+    auto pl = yap::Pipeline{} | tcn::Iota(1u) | doubler |
+              [&](auto) {
+                  std::lock_guard lk(mtx);
+                  sinkThreads.insert(std::this_thread::get_id());
+                  ++counter;
+              };
+
+    for (int cycle(0); cycle < 20; ++cycle)
+    {
+        EXPECT_EQ(yap::ReturnValue::Ok, pl.run());
+        for (auto target = counter.load() + 10; counter < target;)
+        {
+            // Allow some data to flow.
+        }
+        EXPECT_EQ(yap::ReturnValue::Ok, pl.pause());
+    }
+    pl.stop();
+
+    // Parked workers are released on every run, instead of spawning anew.
+    EXPECT_EQ(sinkThreads.size(), 1u);
+}
+
 TEST(TestPipeline, Consume)
 {
     auto gen = [eng = tcn::Iota(1)]() mutable {
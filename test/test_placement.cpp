@@ -0,0 +1,112 @@
+#include "test_common.h"
+#include "yap/pipeline.h"
+#include "yap/placement.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+namespace
+{
+
+auto boundedIota(int last)
+{
+    return [eng = tcn::Iota(1), last]() mutable {
+        int ret = eng();
+        if (ret > last)
+        {
+            throw yap::GeneratorExit{};
+        }
+        return ret;
+    };
+}
+
+} // namespace
+
+TEST(TestPlacement, ParseCpuList)
+{
+    EXPECT_EQ(yap::detail::parseCpuList("0-3,8,10-11\n"),
+              (std::vector<unsigned>{0, 1, 2, 3, 8, 10, 11}));
+    EXPECT_EQ(yap::detail::parseCpuList("5"), (std::vector<unsigned>{5}));
+    EXPECT_TRUE(yap::detail::parseCpuList("").empty());
+}
+
+TEST(TestPlacement, PinnedStage)
+{
+#if defined(__linux__)
+    // Pin to a CPU this process is allowed to use.
+    cpu_set_t allowed;
+    ASSERT_EQ(0, sched_getaffinity(0, sizeof(allowed), &allowed));
+    unsigned target = 0;
+    while (!CPU_ISSET(target, &allowed))
+    {
+        ++target;
+    }
+
+    std::vector<int> result;
+    std::atomic_int misplaced{0};
+
+    yap::Placement placement;
+    placement.cpus = {target};
+    placement.scheduling = yap::SchedulingClass::Batch;
+
+    auto pl = yap::Pipeline{} | boundedIota(100) |
+              yap::Placed(
+                  [&misplaced, target](int val) {
+                      if (static_cast<unsigned>(sched_getcpu()) != target)
+                      {
+                          ++misplaced;
+                      }
+                      return val;
+                  },
+                  placement) |
+              [&result](int val) { result.push_back(val); };
+    pl.consume();
+
+    EXPECT_EQ(misplaced.load(), 0);
+    EXPECT_EQ(result.size(), 100u);
+    EXPECT_EQ(result.back(), 100);
+#else
+    GTEST_SKIP() << "Placement is only supported on Linux";
+#endif
+}
+
+TEST(TestPlacement, Topology)
+{
+#if defined(__linux__)
+    auto node = yap::Placement::node(0);
+    EXPECT_FALSE(node.cpus.empty());
+
+    auto cache = yap::Placement::cacheOf(node.cpus.front());
+    for (auto cpu : cache.cpus)
+    {
+        EXPECT_NE(std::find(node.cpus.begin(), node.cpus.end(), cpu),
+                  node.cpus.end());
+    }
+
+    // Unknown nodes leave the stage free to run anywhere.
+    EXPECT_TRUE(yap::Placement::node(1u << 20).cpus.empty());
+#else
+    GTEST_SKIP() << "Topology is only read on Linux";
+#endif
+}
+
+TEST(TestPlacement, IgnoredOutsideDedicatedThreads)
+{
+    yap::Placement placement;
+    placement.cpus = {0};
+
+    std::vector<int> result;
+    auto pl = yap::Pipeline{yap::WorkStealing{2}} | boundedIota(10) |
+              yap::Placed([](int val) { return val * 2; }, placement) |
+              [&result](int val) { result.push_back(val); };
+    pl.consume();
+
+    EXPECT_EQ(result, (std::vector<int>{2, 4, 6, 8, 10, 12, 14, 16, 18, 20}));
+}
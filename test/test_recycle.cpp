@@ -0,0 +1,134 @@
+#include "test_common.h"
+#include "yap/pipeline.h"
+#include "yap/recycle.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <memory>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+auto finite(int count)
+{
+    return [count, val = 0]() mutable {
+        if (val == count)
+        {
+            throw yap::GeneratorExit{};
+        }
+        return val++;
+    };
+}
+
+} // namespace
+
+TEST(TestRecycle, ReleasedObjectsAreReused)
+{
+    yap::Recycler<std::vector<int>> pool(4);
+    EXPECT_EQ(4u, pool.capacity());
+
+    auto v = pool.acquire();
+    v.resize(tcn::kSmallInputSz);
+    auto *data = v.data();
+    EXPECT_TRUE(pool.release(std::move(v)));
+
+    auto w = pool.acquire();
+    EXPECT_EQ(data, w.data());
+    EXPECT_EQ(1u, pool.misses());
+}
+
+TEST(TestRecycle, BoundedCapacity)
+{
+    yap::Recycler<std::unique_ptr<int>> pool(3); // Rounded up to 4.
+    for (int i(0); i < 4; ++i)
+    {
+        EXPECT_TRUE(pool.release(std::make_unique<int>(i)));
+    }
+
+    auto extra = std::make_unique<int>(4);
+    EXPECT_FALSE(pool.release(std::move(extra)));
+    ASSERT_TRUE(extra); // Left to the caller.
+
+    // First in, first out.
+    for (int i(0); i < 4; ++i)
+    {
+        EXPECT_EQ(i, *pool.acquire());
+    }
+    EXPECT_EQ(nullptr, pool.acquire());
+    EXPECT_EQ(1u, pool.misses());
+}
+
+TEST(TestRecycle, ConcurrentReleaseAndAcquire)
+{
+    constexpr int kThreads = 4;
+    constexpr int kPerThread = 10'000;
+    yap::Recycler<std::unique_ptr<int>> pool(64);
+
+    std::vector<std::vector<int>> taken(kThreads);
+    std::vector<std::thread> threads;
+    for (int t(0); t < kThreads; ++t)
+    {
+        threads.emplace_back([&, t] {
+            for (int i(0); i < kPerThread; ++i)
+            {
+                auto obj = std::make_unique<int>(t * kPerThread + i);
+                while (!pool.release(std::move(obj)))
+                {
+                    if (auto got = pool.acquire())
+                    {
+                        taken[t].push_back(*got);
+                    }
+                }
+            }
+        });
+    }
+    for (auto &t : threads)
+    {
+        t.join();
+    }
+
+    std::vector<int> all;
+    for (auto &v : taken)
+    {
+        all.insert(all.end(), v.begin(), v.end());
+    }
+    while (auto got = pool.acquire())
+    {
+        all.push_back(*got);
+    }
+
+    // Every object comes out exactly once.
+    std::sort(all.begin(), all.end());
+    std::vector<int> expected(kThreads * kPerThread);
+    std::iota(expected.begin(), expected.end(), 0);
+    EXPECT_EQ(expected, all);
+}
+
+TEST(TestRecycle, SteadyPipelineDoesNotAllocate)
+{
+    yap::Recycler<std::vector<int>> payloads(8);
+
+    auto gen = [payloads, next = finite(tcn::kMidInputSz)]() mutable {
+        auto val = next();
+        auto payload = payloads.acquire();
+        payload.assign(tcn::kSmallInputSz, val);
+        return payload;
+    };
+
+    std::size_t sum = 0;
+    auto sink = [payloads, &sum](std::vector<int> payload) {
+        sum += payload.size();
+        payloads.release(std::move(payload));
+    };
+
+    // A single item is in flight when consuming on the calling thread.
+    auto pl = yap::Pipeline{} | gen | sink;
+    pl.consume(yap::Synchronous{});
+
+    EXPECT_EQ(tcn::kMidInputSz * tcn::kSmallInputSz, sum);
+    EXPECT_EQ(1u, payloads.misses());
+}
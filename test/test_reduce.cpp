@@ -0,0 +1,97 @@
+#include "test_common.h"
+#include "yap/pipeline.h"
+#include "yap/reduce.h"
+
+#include <gtest/gtest.h>
+
+#include <functional>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+auto boundedIota = [eng = tcn::Iota(1ull)]() mutable {
+    auto ret = eng();
+    if (ret > tcn::kMidInputSz)
+    {
+        throw yap::GeneratorExit{};
+    }
+    return ret;
+};
+
+using histogram_t = std::map<std::size_t, std::size_t>;
+
+} // namespace
+
+TEST(TestReduce, SumOnConsume)
+{
+    auto sum = yap::Reduce<unsigned long long>(0ull, std::plus<>{},
+                                               std::plus<>{}, 4);
+
+    auto pl = yap::Pipeline{} | boundedIota | sum;
+    pl.consume();
+
+    EXPECT_EQ(sum.result(), tcn::kMidInputSz * (tcn::kMidInputSz + 1) / 2);
+}
+
+TEST(TestReduce, Histogram)
+{
+    std::vector<std::string> words{"one", "three", "five", "seven", "eleven",
+                                   "two", "four",  "six",  "eight", "twelve"};
+
+    auto lengths = yap::Reduce<std::string>(
+        histogram_t{},
+        [](histogram_t acc, std::string const &word) {
+            ++acc[word.size()];
+            return acc;
+        },
+        [](histogram_t lhs, histogram_t const &rhs) {
+            for (auto [len, count] : rhs)
+            {
+                lhs[len] += count;
+            }
+            return lhs;
+        },
+        3);
+
+    auto pl = yap::Pipeline{} | yap::Consume(words.begin(), words.end()) |
+              lengths;
+    pl.consume();
+
+    histogram_t expected{{3, 3}, {4, 2}, {5, 3}, {6, 2}};
+    EXPECT_EQ(lengths.result(), expected);
+}
+
+TEST(TestReduce, ResultOnDemand)
+{
+    auto count = yap::Reduce<unsigned>(
+        0ull, [](auto acc, unsigned) { return acc + 1; }, std::plus<>{});
+
+    auto pl = yap::Pipeline{} | tcn::Iota(1u) | count;
+    pl.run();
+
+    unsigned long long lastCount = 0;
+    while (lastCount < tcn::kSmallInputSz)
+    {
+        auto curCount = count.result();
+        EXPECT_GE(curCount, lastCount);
+        lastCount = curCount;
+    }
+
+    pl.stop();
+    EXPECT_GE(count.result(), lastCount);
+}
+
+TEST(TestReduce, SingleWorker)
+{
+    auto sum = yap::Reduce<int>(0, std::plus<>{}, std::plus<>{}, 0);
+    for (int i(1); i <= 10; ++i)
+    {
+        sum(i);
+    }
+
+    EXPECT_EQ(sum.result(), 55);
+}
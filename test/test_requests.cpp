@@ -0,0 +1,147 @@
+#include "test_common.h"
+#include "yap/arena.h"
+#include "yap/pipeline.h"
+
+#include <gtest/gtest.h>
+
+#include <future>
+#include <memory_resource>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST(TestRequests, EveryRequestGetsItsOwnResult)
+{
+    auto pl = yap::Pipeline{yap::Requests<int>{}} |
+              [](int val) { return 2 * val; } |
+              [](int val) { return std::to_string(val); };
+    pl.run();
+
+    std::vector<yap::Response<std::string>> responses;
+    for (int i(0); i < static_cast<int>(tcn::kMidInputSz); ++i)
+    {
+        responses.push_back(pl.submit(i));
+    }
+    for (int i(0); i < static_cast<int>(tcn::kMidInputSz); ++i)
+    {
+        EXPECT_EQ(std::to_string(2 * i), responses[i].get());
+    }
+    pl.stop();
+}
+
+TEST(TestRequests, ConcurrentSubmitters)
+{
+    constexpr int kSubmitters = 4;
+
+    auto pl = yap::Pipeline{yap::Requests<int>{8}} |
+              [](int val) { return val + 1; } | [](int val) { return -val; };
+    pl.run();
+
+    std::vector<std::thread> submitters;
+    for (int t(0); t < kSubmitters; ++t)
+    {
+        submitters.emplace_back([&pl, t] {
+            for (int i(0); i < static_cast<int>(tcn::kSmallInputSz); ++i)
+            {
+                int req = t * 1000 + i;
+                EXPECT_EQ(-(req + 1), pl.submit(req).get());
+            }
+        });
+    }
+    for (auto &t : submitters)
+    {
+        t.join();
+    }
+    pl.stop();
+}
+
+TEST(TestRequests, FailuresReachTheSubmitter)
+{
+    auto pl = yap::Pipeline{yap::Requests<int>{}} |
+              yap::Filter([](int val) {
+                  return val % 2 ? std::optional<int>(val) : std::nullopt;
+              }) |
+              [](yap::Filtered<int> val) {
+                  if (*val.data == 3)
+                  {
+                      throw std::runtime_error("three");
+                  }
+                  return *val.data;
+              };
+    pl.run();
+
+    auto even = pl.submit(2);
+    auto three = pl.submit(3);
+    auto five = pl.submit(5);
+
+    EXPECT_EQ(5, five.get());
+    EXPECT_THROW(three.get(), std::runtime_error);
+    try
+    {
+        even.get();
+        ADD_FAILURE() << "A filtered request completed";
+    }
+    catch (std::future_error &e)
+    {
+        EXPECT_EQ(std::future_errc::broken_promise, e.code());
+    }
+    pl.stop();
+}
+
+TEST(TestRequests, AwaitResponses)
+{
+    auto pl = yap::Pipeline{yap::Requests<int>{}} |
+              [](int val) { return val * val; };
+    pl.run();
+
+    auto sumOfSquares = [&pl](int n) -> yap::Task<int> {
+        int sum = 0;
+        for (int i(1); i <= n; ++i)
+        {
+            sum += co_await pl.submit(i);
+        }
+        co_return sum;
+    };
+
+    auto task = sumOfSquares(10);
+    EXPECT_EQ(385, yap::detail::wait(task));
+    pl.stop();
+}
+
+TEST(TestRequests, StopFailsPendingRequests)
+{
+    std::promise<void> release;
+    auto gate = release.get_future().share();
+
+    auto pl = yap::Pipeline{yap::Requests<int>{}} | [gate](int val) {
+        gate.wait();
+        return val;
+    };
+    pl.run();
+
+    auto first = pl.submit(1);
+    auto second = pl.submit(2);
+    std::thread stopper([&pl] { pl.stop(); });
+    std::this_thread::sleep_for(1ms);
+    release.set_value();
+    stopper.join();
+
+    // The item in flight may finish, but the queued one is dropped.
+    EXPECT_THROW(second.get(), std::future_error);
+    EXPECT_TRUE(first.ready());
+}
+
+TEST(TestRequests, WrappedOperationsKeepTheirArena)
+{
+    auto words = [](int val, yap::StageContext &ctx) {
+        std::pmr::vector<int> scratch(ctx.arena());
+        scratch.assign(val, 1);
+        return ctx.arena() != std::pmr::get_default_resource();
+    };
+
+    auto pl = yap::Pipeline{yap::Requests<int>{}} | yap::ArenaBacked(words);
+    pl.run();
+    EXPECT_TRUE(pl.submit(16).get());
+    pl.stop();
+}
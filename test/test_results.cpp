@@ -0,0 +1,119 @@
+#include "test_common.h"
+#include "yap/pipeline.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <numeric>
+#include <ranges>
+#include <vector>
+
+namespace
+{
+
+// Generator whose stream ends every count items.
+auto batches(int count)
+{
+    return [count, val = 0]() mutable {
+        if (val == count)
+        {
+            val = 0;
+            throw yap::GeneratorExit{};
+        }
+        return val++;
+    };
+}
+
+std::vector<int> doubled(std::size_t count)
+{
+    std::vector<int> ret(count);
+    std::iota(ret.begin(), ret.end(), 0);
+    for (auto &val : ret)
+    {
+        val *= 2;
+    }
+    return ret;
+}
+
+template <class P> std::vector<int> pull(P &pl)
+{
+    std::vector<int> ret;
+    for (auto &&val : pl.results())
+    {
+        ret.push_back(val);
+    }
+    return ret;
+}
+
+} // namespace
+
+static_assert(std::ranges::input_range<yap::Results<int>>);
+
+TEST(TestResults, PullFromTheLastStage)
+{
+    auto pl = yap::Pipeline{} | batches(tcn::kMidInputSz) |
+              [](int val) { return 2 * val; };
+
+    EXPECT_EQ(doubled(tcn::kMidInputSz), pull(pl));
+
+    // The pipeline is idle once the range ends, so it can pull again.
+    EXPECT_EQ(yap::ReturnValue::NoOp, pl.pause());
+    EXPECT_EQ(doubled(tcn::kMidInputSz), pull(pl));
+}
+
+TEST(TestResults, PullInOtherModes)
+{
+    auto twice = [](int val) { return 2 * val; };
+    {
+        auto pl = yap::Pipeline{yap::WorkStealing{2}} |
+                  batches(tcn::kMidInputSz) | twice;
+        EXPECT_EQ(doubled(tcn::kMidInputSz), pull(pl));
+    }
+    {
+        auto pl =
+            yap::Pipeline{yap::Tokens{4}} | batches(tcn::kMidInputSz) | twice;
+        EXPECT_EQ(doubled(tcn::kMidInputSz), pull(pl));
+        EXPECT_EQ(doubled(tcn::kMidInputSz), pull(pl));
+    }
+    {
+        auto pl = yap::Pipeline{yap::InlineHandoff{}} |
+                  batches(tcn::kMidInputSz) | twice | [](int val) {
+                      return val;
+                  };
+        EXPECT_EQ(doubled(tcn::kMidInputSz), pull(pl));
+    }
+}
+
+TEST(TestResults, MoveOnlyResults)
+{
+    auto pl = yap::Pipeline{} | batches(tcn::kSmallInputSz) |
+              [](int val) { return std::make_unique<int>(val); };
+
+    std::vector<std::unique_ptr<int>> collected;
+    for (auto &&ptr : pl.results())
+    {
+        collected.push_back(std::move(ptr));
+    }
+
+    ASSERT_EQ(tcn::kSmallInputSz, collected.size());
+    for (std::size_t i(0); i < collected.size(); ++i)
+    {
+        EXPECT_EQ(static_cast<int>(i), *collected[i]);
+    }
+}
+
+TEST(TestResults, StopEndsTheRange)
+{
+    auto pl = yap::Pipeline{} | tcn::Iota(0) | [](int val) { return val; };
+
+    std::size_t count = 0;
+    for (auto &&val : pl.results())
+    {
+        EXPECT_EQ(count++, static_cast<std::size_t>(val));
+        if (tcn::kSmallInputSz == count)
+        {
+            EXPECT_EQ(yap::ReturnValue::Ok, pl.stop());
+        }
+    }
+    EXPECT_EQ(tcn::kSmallInputSz, count);
+}
@@ -0,0 +1,113 @@
+#include "test_common.h"
+#include "yap/executor.h"
+#include "yap/pipeline.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <memory>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+auto boundedIota(int last)
+{
+    return [eng = tcn::Iota(1), last]() mutable {
+        int ret = eng();
+        if (ret > last)
+        {
+            throw yap::GeneratorExit{};
+        }
+        return ret;
+    };
+}
+
+} // namespace
+
+TEST(TestSharedExecutor, ManyPipelinesFewThreads)
+{
+    constexpr std::size_t kPipelines = 64;
+    constexpr int kItems = 1'000;
+
+    yap::Executor executor(2);
+    EXPECT_EQ(executor.size(), 2u);
+
+    std::vector<std::vector<int>> results(kPipelines);
+    std::vector<std::unique_ptr<yap::pipeline>> pipelines;
+    for (auto &result : results)
+    {
+        pipelines.push_back(yap::make_pipeline(
+            executor, boundedIota(kItems), [](int val) { return val * 2; },
+            [](int val) { return val / 2; },
+            [&result](int val) { result.push_back(val); }));
+    }
+
+    for (auto &pp : pipelines)
+    {
+        EXPECT_EQ(yap::ReturnValue::Ok, pp->run());
+    }
+    for (auto &pp : pipelines)
+    {
+        EXPECT_EQ(yap::ReturnValue::Ok, pp->consume());
+    }
+
+    std::vector<int> expected(kItems);
+    std::iota(expected.begin(), expected.end(), 1);
+    for (auto const &result : results)
+    {
+        EXPECT_EQ(result, expected);
+    }
+}
+
+TEST(TestSharedExecutor, PausingOnePipelineLeavesOthersRunning)
+{
+    yap::Executor executor(2);
+
+    std::atomic_size_t pausedCount{0}, runningCount{0};
+    auto paused = yap::Pipeline{executor} | tcn::Iota(1u) |
+                  [&pausedCount](unsigned) { ++pausedCount; };
+    auto running = yap::Pipeline{executor} | tcn::Iota(1u) |
+                   [&runningCount](unsigned) { ++runningCount; };
+
+    paused.run();
+    running.run();
+    while (pausedCount < tcn::kSmallInputSz)
+    {
+        // Allow some data to flow.
+    }
+
+    paused.pause();
+    auto countOnPause = pausedCount.load();
+    auto runningOnPause = runningCount.load();
+
+    while (runningCount < runningOnPause + tcn::kSmallInputSz)
+    {
+        // The other pipeline keeps making progress.
+    }
+    EXPECT_EQ(pausedCount.load(), countOnPause);
+
+    paused.run();
+    while (pausedCount < countOnPause + tcn::kSmallInputSz)
+    {
+        // Allow some data to flow.
+    }
+
+    EXPECT_EQ(yap::ReturnValue::Ok, paused.stop());
+    EXPECT_EQ(yap::ReturnValue::Ok, running.stop());
+}
+
+TEST(TestSharedExecutor, PipelineOutlivesExecutorHandle)
+{
+    std::vector<int> result;
+    auto pl = [&result] {
+        yap::Executor executor(1);
+        return yap::Pipeline{executor} | boundedIota(100) |
+               [&result](int val) { result.push_back(val); };
+    }();
+
+    pl.consume();
+    EXPECT_EQ(result.size(), 100u);
+}
@@ -0,0 +1,99 @@
+#include "test_common.h"
+#include "yap/pipeline.h"
+#include "yap/stage_context.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+struct VectorSquarer
+{
+    std::vector<int> operator()(std::vector<int> v, yap::StageContext &ctx)
+    {
+        ctx.parallel_for(0, v.size(), [&v](std::size_t i) { v[i] *= v[i]; });
+        return v;
+    }
+};
+
+} // namespace
+
+TEST(TestStageContext, SerialWithoutPool)
+{
+    yap::StageContext ctx;
+    EXPECT_EQ(ctx.concurrency(), 1u);
+
+    auto caller = std::this_thread::get_id();
+    std::vector<int> visited;
+    ctx.parallel_for(3, 8, [&](std::size_t i) {
+        EXPECT_EQ(caller, std::this_thread::get_id());
+        visited.push_back(static_cast<int>(i));
+    });
+
+    EXPECT_EQ(visited, (std::vector<int>{3, 4, 5, 6, 7}));
+}
+
+TEST(TestStageContext, EveryIndexVisitedOnce)
+{
+    yap::StageContext ctx(std::make_shared<yap::detail::WorkerPool>(3));
+    EXPECT_EQ(ctx.concurrency(), 4u);
+
+    std::vector<std::atomic_int> visits(tcn::kMidInputSz);
+    ctx.parallel_for(0, visits.size(), [&](std::size_t i) { ++visits[i]; }, 7);
+
+    for (auto &v : visits)
+    {
+        EXPECT_EQ(v.load(), 1);
+    }
+}
+
+TEST(TestStageContext, ExceptionsPropagate)
+{
+    yap::StageContext ctx(std::make_shared<yap::detail::WorkerPool>(2));
+
+    std::atomic_size_t visits{0};
+    EXPECT_THROW(ctx.parallel_for(0, tcn::kSmallInputSz,
+                                  [&](std::size_t i) {
+                                      ++visits;
+                                      if (i == tcn::kSmallInputSz / 2)
+                                      {
+                                          throw std::runtime_error("bad");
+                                      }
+                                  },
+                                  1),
+                 std::runtime_error);
+
+    // The loop runs to completion before the error is reported.
+    EXPECT_EQ(visits.load(), tcn::kSmallInputSz);
+}
+
+TEST(TestStageContext, DataParallelStage)
+{
+    std::vector<std::vector<int>> input(10, std::vector<int>(1'000));
+    for (auto &v : input)
+    {
+        std::iota(v.begin(), v.end(), 0);
+    }
+
+    std::vector<std::vector<int>> output;
+    auto pl = yap::Pipeline{} | yap::Consume(input.begin(), input.end()) |
+              VectorSquarer{} |
+              [&output](std::vector<int> v) { output.push_back(std::move(v)); };
+    pl.consume();
+
+    ASSERT_EQ(output.size(), input.size());
+    for (auto const &v : output)
+    {
+        for (std::size_t i(0); i < v.size(); ++i)
+        {
+            EXPECT_EQ(v[i], static_cast<int>(i * i));
+        }
+    }
+}
@@ -0,0 +1,185 @@
+#include "test_common.h"
+#include "yap/fuse.h"
+#include "yap/pipeline.h"
+#include "yap/tokens.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+enum class Event
+{
+    Start,
+    Item,
+    Stop
+};
+
+struct Log
+{
+    std::mutex mtx;
+    std::vector<Event> events;
+    std::vector<std::thread::id> threads;
+
+    void add(Event event)
+    {
+        std::lock_guard lk(mtx);
+        events.push_back(event);
+        threads.push_back(std::this_thread::get_id());
+    }
+
+    std::size_t count(Event event)
+    {
+        std::lock_guard lk(mtx);
+        return std::count(events.begin(), events.end(), event);
+    }
+};
+
+// Transform that logs its hooks and the items it processes.
+struct Hooked
+{
+    std::shared_ptr<Log> log;
+
+    void on_start()
+    {
+        log->add(Event::Start);
+    }
+
+    void on_stop()
+    {
+        log->add(Event::Stop);
+    }
+
+    int operator()(int val)
+    {
+        log->add(Event::Item);
+        return val;
+    }
+};
+
+auto finite(int count)
+{
+    return [count, val = 0]() mutable {
+        if (val == count)
+        {
+            throw yap::GeneratorExit{};
+        }
+        return val++;
+    };
+}
+
+// Every item is processed between a start and a stop hook.
+void expectBracketed(Log const &log, std::size_t items)
+{
+    ASSERT_EQ(items + 2, log.events.size());
+    EXPECT_EQ(Event::Start, log.events.front());
+    EXPECT_EQ(Event::Stop, log.events.back());
+    for (std::size_t i(1); i + 1 < log.events.size(); ++i)
+    {
+        EXPECT_EQ(Event::Item, log.events[i]);
+    }
+}
+
+} // namespace
+
+TEST(TestStageHooks, HooksRunOnTheStageThread)
+{
+    auto log = std::make_shared<Log>();
+    auto pl = yap::Pipeline{} | finite(tcn::kSmallInputSz) | Hooked{log} |
+              [](int) {};
+
+    EXPECT_EQ(yap::ReturnValue::Ok, pl.consume());
+    expectBracketed(*log, tcn::kSmallInputSz);
+    for (auto id : log->threads)
+    {
+        EXPECT_EQ(log->threads.front(), id);
+    }
+    EXPECT_NE(std::this_thread::get_id(), log->threads.front());
+}
+
+TEST(TestStageHooks, HooksRunOnEveryRun)
+{
+    auto log = std::make_shared<Log>();
+    auto pl = yap::Pipeline{} | tcn::Iota(0) | Hooked{log} | [](int) {};
+
+    for (std::size_t run(1); run <= 3; ++run)
+    {
+        EXPECT_EQ(yap::ReturnValue::Ok, pl.run(yap::Warm{}));
+        EXPECT_EQ(run, log->count(Event::Start));
+        EXPECT_EQ(yap::ReturnValue::Ok, pl.pause());
+        EXPECT_EQ(run, log->count(Event::Stop));
+    }
+    pl.stop();
+}
+
+TEST(TestStageHooks, RunWaitsUntilWarm)
+{
+    struct Slow
+    {
+        std::atomic_bool *warm;
+
+        void on_start()
+        {
+            std::this_thread::sleep_for(20ms);
+            *warm = true;
+        }
+
+        int operator()(int val)
+        {
+            return val;
+        }
+    };
+
+    std::atomic_bool warm{false};
+    auto pl = yap::Pipeline{} | tcn::Iota(0) | Slow{&warm} | [](int) {};
+
+    EXPECT_EQ(yap::ReturnValue::Ok, pl.run(yap::Warm{}));
+    EXPECT_TRUE(warm);
+    EXPECT_EQ(yap::ReturnValue::NoOp, pl.run(yap::Warm{}));
+    pl.stop();
+}
+
+TEST(TestStageHooks, HooksInOtherModes)
+{
+    {
+        auto log = std::make_shared<Log>();
+        auto pl = yap::Pipeline{yap::WorkStealing{2}} |
+                  finite(tcn::kSmallInputSz) | Hooked{log} | [](int) {};
+        pl.consume();
+        expectBracketed(*log, tcn::kSmallInputSz);
+    }
+    {
+        auto log = std::make_shared<Log>();
+        auto pl = yap::Pipeline{yap::Tokens{2}} | finite(tcn::kSmallInputSz) |
+                  Hooked{log} | [](int) {};
+        pl.consume();
+        expectBracketed(*log, tcn::kSmallInputSz);
+    }
+    {
+        auto log = std::make_shared<Log>();
+        auto pl = yap::Pipeline{} | finite(tcn::kSmallInputSz) | Hooked{log} |
+                  [](int) {};
+        pl.consume(yap::Synchronous{});
+        expectBracketed(*log, tcn::kSmallInputSz);
+    }
+}
+
+TEST(TestStageHooks, WrappersForwardHooks)
+{
+    auto log = std::make_shared<Log>();
+    auto pl = yap::Pipeline{yap::Tokens{2}} | finite(tcn::kSmallInputSz) |
+              yap::Stateless(Hooked{log}) |
+              yap::Fuse(Hooked{log}, [](int) {});
+
+    pl.consume();
+    EXPECT_EQ(2u, log->count(Event::Start));
+    EXPECT_EQ(2u, log->count(Event::Stop));
+    EXPECT_EQ(2 * tcn::kSmallInputSz, log->count(Event::Item));
+}
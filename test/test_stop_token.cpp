@@ -0,0 +1,121 @@
+#include "test_common.h"
+#include "yap/pipeline.h"
+#include "yap/stage.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <stop_token>
+#include <thread>
+
+namespace
+{
+
+// Time taken by a callable.
+template <class F> auto timed(F &&f)
+{
+    auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::steady_clock::now() - start;
+}
+
+} // namespace
+
+TEST(TestStopToken, BlockedPopReturnsOnStop)
+{
+    auto inQ = std::make_shared<yap::BufferQueue<std::future<int>>>();
+    yap::Stage<int, void> sinkStage([](int) {});
+    sinkStage.start(inQ, nullptr);
+
+    // The buffer is never closed, only the stop request wakes the sink.
+    std::this_thread::sleep_for(1ms);
+    auto elapsed = timed([&] {
+        sinkStage.stop();
+        sinkStage.halt();
+    });
+    EXPECT_LT(elapsed, 100ms);
+}
+
+TEST(TestStopToken, LongOperationsReturnEarly)
+{
+    std::atomic_int started{0};
+
+    // Without the token every item would take ten seconds.
+    auto slow = [&started](int val, std::stop_token stop) {
+        ++started;
+        for (int i(0); i < 10'000 && !stop.stop_requested(); ++i)
+        {
+            std::this_thread::sleep_for(1ms);
+        }
+        return val;
+    };
+
+    auto pl = yap::Pipeline{} | tcn::Iota(1) | slow | [](int) {};
+    pl.run();
+    while (!started)
+    {
+        std::this_thread::yield();
+    }
+
+    auto elapsed = timed([&] { EXPECT_EQ(yap::ReturnValue::Ok, pl.stop()); });
+    EXPECT_LT(elapsed, 500ms);
+}
+
+TEST(TestStopToken, TokenThroughContext)
+{
+    std::atomic_int cancelled{0};
+    std::atomic_int started{0};
+
+    auto slow = [&](int val, yap::StageContext &ctx) {
+        std::stop_callback onStop(ctx.stopToken(), [&] { ++cancelled; });
+        ++started;
+        while (!ctx.stopToken().stop_requested())
+        {
+            std::this_thread::sleep_for(1ms);
+        }
+        return val;
+    };
+
+    auto pl = yap::Pipeline{yap::WorkStealing{2}} | tcn::Iota(1) | slow |
+              [](int) {};
+    pl.run();
+    while (!started)
+    {
+        std::this_thread::yield();
+    }
+    pl.stop();
+
+    EXPECT_EQ(cancelled.load(), 1);
+}
+
+TEST(TestStopToken, FreshTokenOnResume)
+{
+    std::atomic_int stoppedOnEntry{0};
+    std::atomic_int calls{0};
+
+    auto pl = yap::Pipeline{} | tcn::Iota(1) |
+              [&](int val, std::stop_token stop) {
+                  if (stop.stop_requested())
+                  {
+                      ++stoppedOnEntry;
+                  }
+                  ++calls;
+                  return val;
+              } |
+              [](int) {};
+
+    for (int cycle(0); cycle < 5; ++cycle)
+    {
+        pl.run();
+        for (auto target = calls.load() + 10; calls < target;)
+        {
+            std::this_thread::yield();
+        }
+        pl.pause();
+    }
+
+    // Only calls racing with a pause can see the request.
+    EXPECT_LE(stoppedOnEntry.load(), 5);
+    EXPECT_GE(calls.load(), 50);
+}
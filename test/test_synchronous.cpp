@@ -0,0 +1,129 @@
+#include "test_common.h"
+#include "yap/pipeline.h"
+#include "yap/topology.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <numeric>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+auto boundedIota(int last)
+{
+    return [eng = tcn::Iota(1), last]() mutable {
+        int ret = eng();
+        if (ret > last)
+        {
+            throw yap::GeneratorExit{};
+        }
+        return ret;
+    };
+}
+
+} // namespace
+
+TEST(TestSynchronous, RunsOnCallerThread)
+{
+    auto caller = std::this_thread::get_id();
+    std::vector<int> result, expected(tcn::kSmallInputSz);
+    std::iota(expected.begin(), expected.end(), 1);
+
+    auto pl = yap::Pipeline{} |
+              boundedIota(static_cast<int>(tcn::kSmallInputSz)) |
+              [caller](int val) {
+                  EXPECT_EQ(caller, std::this_thread::get_id());
+                  return val;
+              } |
+              [&result, caller](int val) {
+                  EXPECT_EQ(caller, std::this_thread::get_id());
+                  result.push_back(val);
+              };
+
+    EXPECT_EQ(yap::ReturnValue::Ok, pl.consume(yap::Synchronous{}));
+    EXPECT_EQ(result, expected);
+}
+
+TEST(TestSynchronous, FilteringAndHatching)
+{
+    std::vector<int> source{1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+    std::vector<int> dest;
+
+    // Keep odd numbers, then output N copies of each number N.
+    auto pl =
+        yap::Pipeline{} | yap::Consume(source.begin(), source.end()) |
+        yap::Filter([](int val) {
+            return val % 2 ? std::optional<int>(val) : std::nullopt;
+        }) |
+        [](yap::Filtered<int> val) { return yap::Hatchable<int>(*val.data); } |
+        [cur = 0, count = 0](yap::Hatchable<int> val) mutable {
+            if (val)
+            {
+                cur = count = *val.data;
+            }
+            return count-- > 0 ? std::optional<int>(cur) : std::nullopt;
+        } |
+        [&dest](std::optional<int> val) { dest.push_back(*val); };
+    pl.consume(yap::Synchronous{});
+
+    EXPECT_EQ(dest, (std::vector<int>{1, 3, 3, 3, 5, 5, 5, 5, 5, 7, 7, 7, 7,
+                                      7, 7, 7, 9, 9, 9, 9, 9, 9, 9, 9, 9}));
+}
+
+TEST(TestSynchronous, SizeHintSelectsMode)
+{
+    auto caller = std::this_thread::get_id();
+    std::vector<bool> onCaller;
+
+    auto pp = yap::make_pipeline(
+        boundedIota(10), [](int val) { return val; },
+        [&onCaller, caller](int) {
+            onCaller.push_back(caller == std::this_thread::get_id());
+        });
+
+    pp->consume(yap::SizeHint{10});
+    EXPECT_EQ(onCaller, std::vector<bool>(10, true));
+
+    auto pl = yap::Pipeline{} | boundedIota(10) |
+              [](int val) { return val; } |
+              [&onCaller, caller](int) {
+                  onCaller.push_back(caller == std::this_thread::get_id());
+              };
+
+    onCaller.clear();
+    pl.consume(yap::SizeHint{10, 5});
+    EXPECT_EQ(onCaller, std::vector<bool>(10, false));
+}
+
+TEST(TestSynchronous, ResumePausedPipeline)
+{
+    std::vector<int> result;
+
+    auto pl = yap::Pipeline{} |
+              boundedIota(static_cast<int>(tcn::kMidInputSz)) |
+              [](int val) { return val * 2; } |
+              [&result](int val) { result.push_back(val / 2); };
+
+    pl.run();
+    std::this_thread::sleep_for(1ms);
+    pl.pause();
+
+    // Items left in the buffers are processed before new ones.
+    EXPECT_EQ(yap::ReturnValue::Ok, pl.consume(yap::Synchronous{}));
+    ASSERT_FALSE(result.empty());
+    EXPECT_TRUE(std::is_sorted(result.begin(), result.end()));
+    EXPECT_EQ(result.back(), static_cast<int>(tcn::kMidInputSz));
+}
+
+TEST(TestSynchronous, RunningPipelineIsNotConsumed)
+{
+    auto pl = yap::Pipeline{} | tcn::Iota(1u) | [](unsigned) {};
+    pl.run();
+
+    EXPECT_EQ(yap::ReturnValue::NoOp, pl.consume(yap::Synchronous{}));
+    EXPECT_EQ(yap::ReturnValue::Ok, pl.stop());
+}
@@ -0,0 +1,150 @@
+#include "test_common.h"
+#include "yap/pipeline.h"
+#include "yap/tokens.h"
+#include "yap/topology.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+auto boundedIota = [eng = tcn::Iota(1)]() mutable {
+    int ret = eng();
+    if (ret > static_cast<int>(tcn::kMidInputSz))
+    {
+        throw yap::GeneratorExit{};
+    }
+    return ret;
+};
+
+} // namespace
+
+TEST(TestTokens, SerialStagesPreserveOrder)
+{
+    std::vector<int> result, expected(tcn::kMidInputSz);
+    std::iota(expected.begin(), expected.end(), 1);
+
+    auto pl = yap::Pipeline{yap::Tokens{4}} | boundedIota |
+              [](int val) { return val + 1; } |
+              [](int val) { return val - 1; } |
+              [&result](int val) { result.push_back(val); };
+    pl.consume();
+
+    EXPECT_EQ(result, expected);
+}
+
+TEST(TestTokens, StatelessStageBeforeSerialSink)
+{
+    std::vector<int> result;
+
+    auto pl = yap::Pipeline{yap::Tokens{4}} | boundedIota |
+              yap::Stateless([](int val) {
+                  std::this_thread::yield(); // Let tokens overtake each other.
+                  return val * 2;
+              }) |
+              [&result](int val) { result.push_back(val); };
+    pl.consume();
+
+    // The sink is serial, so items arrive in order.
+    ASSERT_EQ(result.size(), tcn::kMidInputSz);
+    for (std::size_t i(0); i < result.size(); ++i)
+    {
+        EXPECT_EQ(result[i], 2 * static_cast<int>(i + 1));
+    }
+}
+
+TEST(TestTokens, FilteringAndHatching)
+{
+    std::vector<int> source{1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+    std::vector<int> dest;
+
+    // Keep odd numbers, then output N copies of each number N.
+    auto pl =
+        yap::Pipeline{yap::Tokens{3}} |
+        yap::Consume(source.begin(), source.end()) |
+        yap::Filter([](int val) {
+            return val % 2 ? std::optional<int>(val) : std::nullopt;
+        }) |
+        [](yap::Filtered<int> val) { return yap::Hatchable<int>(*val.data); } |
+        [cur = 0, count = 0](yap::Hatchable<int> val) mutable {
+            if (val)
+            {
+                cur = count = *val.data;
+            }
+            return count-- > 0 ? std::optional<int>(cur) : std::nullopt;
+        } |
+        [&dest](std::optional<int> val) { dest.push_back(*val); };
+    pl.consume();
+
+    EXPECT_EQ(dest, (std::vector<int>{1, 3, 3, 3, 5, 5, 5, 5, 5, 7, 7, 7, 7,
+                                      7, 7, 7, 9, 9, 9, 9, 9, 9, 9, 9, 9}));
+}
+
+TEST(TestTokens, ItemsStayOnOneThread)
+{
+    std::mutex mtx;
+    std::set<std::thread::id> threads;
+    std::atomic_int mismatches{0};
+
+    auto pl = yap::make_pipeline(
+        yap::Tokens{2}, boundedIota,
+        yap::Stateless([](int val) {
+            return std::make_pair(val, std::this_thread::get_id());
+        }),
+        [&](std::pair<int, std::thread::id> const &item) {
+            if (item.second != std::this_thread::get_id())
+            {
+                ++mismatches;
+            }
+            std::lock_guard lk(mtx);
+            threads.insert(item.second);
+        });
+    pl->consume();
+
+    EXPECT_EQ(mismatches.load(), 0);
+    EXPECT_LE(threads.size(), 2u);
+}
+
+TEST(TestTokens, PauseResume)
+{
+    unsigned long long counter = 0;
+    std::atomic_ullong atomicCounter = 0;
+    // The sink is serial, so the plain counter is never modified in parallel.
+    auto mockSink = [&counter, &atomicCounter](auto) {
+        ++counter;
+        ++atomicCounter;
+    };
+
+    auto pl = yap::Pipeline{yap::Tokens{3}} | tcn::Iota(1u) |
+              yap::Stateless([](unsigned val) { return val + 1; }) | mockSink;
+    pl.run();
+
+    while (atomicCounter < tcn::kSmallInputSz)
+    {
+        // Allow some data to flow.
+    }
+
+    pl.pause();
+
+    auto acValueOnPause = atomicCounter.load();
+    EXPECT_EQ(acValueOnPause, counter);
+    std::this_thread::sleep_for(1ms);
+    EXPECT_EQ(atomicCounter.load(), acValueOnPause);
+
+    pl.run();
+    while (atomicCounter < acValueOnPause + tcn::kSmallInputSz)
+    {
+        // Allow some data to flow.
+    }
+
+    EXPECT_EQ(yap::ReturnValue::Ok, pl.stop());
+    EXPECT_EQ(atomicCounter.load(), counter);
+}
@@ -0,0 +1,117 @@
+#include "test_common.h"
+#include "yap/pipeline.h"
+#include "yap/top_k.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+// Produces "i" repeated "i" times for every i in [1, n].
+std::vector<int> triangle(int n)
+{
+    std::vector<int> ret;
+    for (int i(1); i <= n; ++i)
+    {
+        ret.insert(ret.end(), i, i);
+    }
+    return ret;
+}
+
+} // namespace
+
+TEST(TestTopK, ExactSink)
+{
+    auto input = triangle(100);
+    yap::TopK<int> top(5);
+
+    auto pl = yap::Pipeline{} | yap::Consume(input.begin(), input.end()) | top;
+    pl.consume();
+
+    std::vector<std::pair<int, std::size_t>> expected{
+        {100, 100}, {99, 99}, {98, 98}, {97, 97}, {96, 96}};
+    EXPECT_EQ(top.get(), expected);
+}
+
+TEST(TestTopK, ExactRanges)
+{
+    std::vector<std::string> lines{"a b c", "b c", "c", "d d d d"};
+    yap::TopK<std::string> top(2);
+
+    auto splitter = [](std::string line) {
+        std::vector<std::string> words;
+        for (char c : line)
+        {
+            if (c != ' ')
+            {
+                words.emplace_back(1, c);
+            }
+        }
+        return words;
+    };
+
+    auto pl = yap::Pipeline{} | yap::Consume(lines.begin(), lines.end()) |
+              splitter | top;
+    pl.consume();
+
+    std::vector<std::pair<std::string, std::size_t>> expected{{"d", 4},
+                                                              {"c", 3}};
+    EXPECT_EQ(top.get(), expected);
+}
+
+TEST(TestTopK, SpaceSavingKeepsHeavyHitters)
+{
+    // Heavy hitters interleaved with a long tail of unique keys.
+    std::vector<int> input;
+    for (int i(0); i < static_cast<int>(tcn::kMidInputSz); ++i)
+    {
+        input.push_back(i % 3 ? -(i % 3) : i);
+    }
+
+    yap::TopK<int> top(2, yap::SpaceSaving{16});
+    for (int key : input)
+    {
+        top(key);
+    }
+
+    auto result = top.get();
+    ASSERT_EQ(result.size(), 2u);
+    EXPECT_EQ(std::min(result[0].first, result[1].first), -2);
+    EXPECT_EQ(std::max(result[0].first, result[1].first), -1);
+
+    // Counts may only overestimate the true frequencies.
+    for (auto [key, count] : result)
+    {
+        EXPECT_GE(count, tcn::kMidInputSz / 3);
+    }
+}
+
+TEST(TestTopK, PeriodicEmitter)
+{
+    auto input = triangle(10);
+    std::vector<yap::TopK<int>::result_t> snapshots;
+
+    yap::TopK<int> top(1);
+    auto pl = yap::Pipeline{} | yap::Consume(input.begin(), input.end()) |
+              top.emitter(11) | [&snapshots](auto snapshot) {
+                  snapshots.push_back(std::move(*snapshot.data));
+              };
+    pl.consume();
+
+    ASSERT_EQ(snapshots.size(), input.size() / 11);
+    for (auto const &snapshot : snapshots)
+    {
+        EXPECT_EQ(snapshot.size(), 1u);
+    }
+    EXPECT_EQ(top.get().front(), std::make_pair(10, std::size_t{10}));
+}
+
+TEST(TestTopK, RejectsInvalidParameters)
+{
+    EXPECT_THROW(yap::TopK<int>(0), std::logic_error);
+    EXPECT_THROW(yap::TopK<int>(5, yap::SpaceSaving{4}), std::logic_error);
+}
@@ -0,0 +1,141 @@
+#include "test_common.h"
+#include "yap/executor.h"
+#include "yap/pipeline.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <future>
+#include <numeric>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+auto boundedIota = [eng = tcn::Iota(1)]() mutable {
+    int ret = eng();
+    if (ret > static_cast<int>(tcn::kMidInputSz))
+    {
+        throw yap::GeneratorExit{};
+    }
+    return ret;
+};
+
+const auto increment = [](int val) { return val + 1; };
+const auto decrement = [](int val) { return val - 1; };
+
+} // namespace
+
+TEST(TestWorkStealing, PoolRunsNestedTasks)
+{
+    std::atomic_int counter{0};
+    std::promise<void> done;
+    {
+        yap::detail::WorkStealingPool pool(2);
+
+        for (int i(0); i < 100; ++i)
+        {
+            pool.post([&] {
+                ++counter;
+                pool.post([&] { ++counter; });
+                pool.defer([&] { ++counter; });
+            });
+        }
+    } // Pending tasks are processed before the pool is destroyed.
+
+    EXPECT_EQ(counter.load(), 300);
+}
+
+TEST(TestWorkStealing, MoreStagesThanThreads)
+{
+    std::vector<int> result, expected(tcn::kMidInputSz);
+    std::iota(expected.begin(), expected.end(), 1);
+
+    auto pl = yap::Pipeline{yap::WorkStealing{2}} | boundedIota | increment |
+              increment | decrement | increment | decrement | decrement |
+              [&result](int val) { result.push_back(val); };
+    pl.consume();
+
+    EXPECT_EQ(result, expected);
+}
+
+TEST(TestWorkStealing, PauseResume)
+{
+    unsigned long long counter = 0;
+    std::atomic_ullong atomicCounter = 0;
+    // Two counters are used, one for parallel access and one intentionally
+    // non thread-safe to verify it's not modified in parallel.
+    auto mockSink = [&counter, &atomicCounter](auto) {
+        ++counter;
+        ++atomicCounter;
+    };
+
+    auto pl = yap::Pipeline{yap::WorkStealing{2}} | tcn::Iota(1u) | increment |
+              mockSink;
+    pl.run();
+
+    while (atomicCounter < tcn::kSmallInputSz)
+    {
+        // Allow some data to flow.
+    }
+
+    pl.pause();
+
+    // Verify the stage function isn't called after pause.
+    auto acValueOnPause = atomicCounter.load();
+    EXPECT_EQ(acValueOnPause, counter);
+    std::this_thread::sleep_for(1ms);
+    EXPECT_EQ(atomicCounter.load(), acValueOnPause);
+
+    pl.run(); // Resume the pipeline.
+    while (atomicCounter < acValueOnPause + tcn::kSmallInputSz)
+    {
+        // Allow some data to flow.
+    }
+
+    EXPECT_EQ(yap::ReturnValue::Ok, pl.stop());
+    EXPECT_EQ(atomicCounter.load(), counter);
+}
+
+TEST(TestWorkStealing, FilteringAndHatching)
+{
+    std::vector<int> source{1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+    std::vector<int> dest;
+
+    // Keep odd numbers, then output N copies of each number N.
+    auto pl =
+        yap::Pipeline{yap::WorkStealing{2}} |
+        yap::Consume(source.begin(), source.end()) |
+        yap::Filter([](int val) {
+            return val % 2 ? std::optional<int>(val) : std::nullopt;
+        }) |
+        [](yap::Filtered<int> val) { return yap::Hatchable<int>(*val.data); } |
+        [cur = 0, count = 0](yap::Hatchable<int> val) mutable {
+            if (val)
+            {
+                cur = count = *val.data;
+            }
+            return count-- > 0 ? std::optional<int>(cur) : std::nullopt;
+        } |
+        [&dest](std::optional<int> val) { dest.push_back(*val); };
+    pl.consume();
+
+    EXPECT_EQ(dest, (std::vector<int>{1, 3, 3, 3, 5, 5, 5, 5, 5, 7, 7, 7, 7,
+                                      7, 7, 7, 9, 9, 9, 9, 9, 9, 9, 9, 9}));
+}
+
+TEST(TestWorkStealing, ConsumePolymorphic)
+{
+    std::vector<int> result, expected(tcn::kMidInputSz);
+    std::iota(expected.begin(), expected.end(), 1);
+
+    auto pp = yap::make_pipeline(yap::WorkStealing{3}, boundedIota, increment,
+                                 decrement,
+                                 [&result](int val) { result.push_back(val); });
+    pp->consume();
+
+    EXPECT_EQ(result, expected);
+}